@@ -1,13 +1,47 @@
+#ifndef ASSEMBLER_HPP
+#define ASSEMBLER_HPP
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "object_file.hpp"
+
 using namespace std;
 
+// entries in a .vectors table, one for each interrupt cause
+const unsigned int VECTOR_COUNT = 16;
+// section of a symbol that is not defined in this file
+const unsigned int NO_SECTION = -1;
+// farthest a 12 bit displacement reaches forward from pc
+const int MAX_DISPLACEMENT = 0x7FF;
+
+// Every distinct identifier is copied once into blocks that never move and
+// is known by its index from then on. Symbols, sections, pools and
+// relocations all refer to names by index.
+class Interner {
+  private:
+    vector<unique_ptr<char[]>> blocks;
+    size_t block_used = 0;
+    size_t block_size = 0;
+    unordered_map<string_view, unsigned int> ids;
+    vector<string_view> names;
+
+  public:
+    unsigned int intern(string_view name);
+    string_view name(unsigned int id) { return names[id]; }
+    unsigned int size() { return names.size(); }
+};
+
 struct Operand {
     int adressing_mode;
     int literal;
-    string symbol;
+    unsigned int symbol;
     int reg;
 };
 
@@ -16,6 +50,10 @@ struct Instruction {
     int gpr1;
     int gpr2;
     int csr;
+    // the symbol operand is in reach of a 12 bit displacement from pc
+    bool pc_relative = false;
+    // it fell out of reach in an earlier pass and stays in the pool
+    bool far = false;
 };
 
 enum AdressingMode {
@@ -30,48 +68,76 @@ enum AdressingMode {
 };
 
 struct Symbol {
-    int value;
-    bool is_global;
-    bool is_defined;
-    string section_name;
-
-    Symbol() {}
-
-    Symbol(bool is_global, bool is_defined) {
-        this->is_global = is_global;
-        this->is_defined = is_defined;
-    }
-
-    Symbol(int value, bool is_global, bool is_defined, string section_name)
-        : Symbol(is_global, is_defined) {
-        this->value = value;
-        this->section_name = section_name;
-    }
+    int value = 0;
+    bool is_global = false;
+    bool is_defined = false;
+    unsigned int section = NO_SECTION;
 };
 
 struct Relocation {
     unsigned int offset;
     int addend;
-    string symbol;
+    unsigned int symbol;
 
-    Relocation(int offset, int addend, string symbol) {
+    Relocation(int offset, int addend, unsigned int symbol) {
         this->offset = offset;
         this->addend = addend;
         this->symbol = symbol;
     }
 };
 
+// Literals and symbol values loaded relative to pc, in order of first use
+// and each with the section offset of its slot. A section has a pool for
+// each place one was put down, and the last one is still open.
+struct Pool {
+    vector<pair<int, int>> literals;
+    vector<pair<unsigned int, int>> symbols;
+    // where each value is in the order
+    unordered_map<int, size_t> literal_index;
+    unordered_map<unsigned int, size_t> symbol_index;
+    // the first load from the pool, which is the farthest from it
+    int first_use = 0;
+
+    bool empty() { return literals.empty() && symbols.empty(); }
+    int size() { return 4 * (literals.size() + symbols.size()); }
+
+    void add_literal(int literal) {
+        if (literal_index.emplace(literal, literals.size()).second) {
+            literals.emplace_back(literal, -1);
+        }
+    }
+
+    void add_symbol(unsigned int symbol) {
+        if (symbol_index.emplace(symbol, symbols.size()).second) {
+            symbols.emplace_back(symbol, -1);
+        }
+    }
+
+    // section offset of a value's slot, -1 without one
+    int literal_slot(int literal) {
+        auto it = literal_index.find(literal);
+        return it == literal_index.end() ? -1 : literals[it->second].second;
+    }
+
+    int symbol_slot(unsigned int symbol) {
+        auto it = symbol_index.find(symbol);
+        return it == symbol_index.end() ? -1 : symbols[it->second].second;
+    }
+};
+
 class Section {
   public:
     vector<unsigned char> content;
-    unordered_map<int, int> literal_pool;
-    unordered_map<string, int> symbol_pool;
+    vector<Pool> pools = vector<Pool>(1);
     vector<Relocation> relocations;
+    // counted by the first pass, so the encoder allocates the relocations
+    // of the section at once
+    unsigned int relocation_count = 0;
     int length = 0;
-    string name;
+    unsigned int name;
 
     Section() {}
-    Section(string name) : name(name) {}
+    Section(unsigned int name) : name(name) {}
 
     void add_bytes(vector<unsigned char> bytes) {
         for (auto byte : bytes) {
@@ -93,38 +159,127 @@ class Section {
             location++;
         }
     }
+};
 
-    void allocate_literals() {
-        for (auto &it : literal_pool) {
-            it.second = length;
-            length += 4;
-        }
-    }
+enum StatementKind {
+    LABEL_STATEMENT,
+    LINE_END,
+    GLOBAL_DIRECTIVE,
+    EXTERN_DIRECTIVE,
+    SECTION_DIRECTIVE,
+    WORD_SYMBOL_DIRECTIVE,
+    WORD_LITERAL_DIRECTIVE,
+    SKIP_DIRECTIVE,
+    VECTORS_DIRECTIVE,
+    LTORG_DIRECTIVE,
+    END_DIRECTIVE,
+    HALT_INSTRUCTION,
+    INT_INSTRUCTION,
+    IRET_INSTRUCTION,
+    RET_INSTRUCTION,
+    CALL_INSTRUCTION,
+    JMP_INSTRUCTION,
+    BEQ_INSTRUCTION,
+    BNE_INSTRUCTION,
+    BGT_INSTRUCTION,
+    PUSH_INSTRUCTION,
+    POP_INSTRUCTION,
+    XCHG_INSTRUCTION,
+    ADD_INSTRUCTION,
+    SUB_INSTRUCTION,
+    MUL_INSTRUCTION,
+    DIV_INSTRUCTION,
+    NOT_INSTRUCTION,
+    AND_INSTRUCTION,
+    OR_INSTRUCTION,
+    XOR_INSTRUCTION,
+    SHL_INSTRUCTION,
+    SHR_INSTRUCTION,
+    LD_INSTRUCTION,
+    ST_INSTRUCTION,
+    CSRRD_INSTRUCTION,
+    CSRWR_INSTRUCTION
+};
 
-    void alocate_symbols() {
-        for (auto &it : symbol_pool) {
-            it.second = length;
-            length += 4;
-        }
-    }
+// a pool put down before a statement, either where control never falls
+// through or with a jump around it
+enum PoolPlacement { NO_POOL, INLINE_POOL, BRANCHED_POOL };
 
-    void write_literals() {
-        for (auto &it : literal_pool) {
-            write_int(it.first, it.second);
-        }
-    }
+// One parser action, kept so that both passes run from memory instead of
+// parsing the source twice. Instructions carry their operands, directives
+// their symbol list or number, which for labels, .section and .word of a
+// symbol is the interned name. Line ends carry the source line and whether
+// it was code. Statements are only ever moved.
+struct Statement {
+    StatementKind kind;
+    Instruction instruction;
+    vector<unsigned int> symbols;
+    int number = 0;
+    bool is_code = false;
+    // decided by the first pass, followed by the second
+    PoolPlacement pool = NO_POOL;
 
-    void register_literal(int literal) {
-        if (literal_pool.find(literal) == literal_pool.end()) {
-            literal_pool[literal] = -1;
-        }
-    }
+    Statement(StatementKind kind) : kind(kind) {}
 
-    void register_symbol(string name) {
-        if (symbol_pool.find(name) == symbol_pool.end()) {
-            symbol_pool[name] = -1;
-        }
-    }
+    Statement(StatementKind kind, Instruction instruction)
+        : kind(kind), instruction(instruction) {}
+
+    Statement(StatementKind kind, vector<unsigned int> symbols)
+        : kind(kind), symbols(move(symbols)) {}
+
+    Statement(StatementKind kind, int number, bool is_code = false)
+        : kind(kind), number(number), is_code(is_code) {}
+
+    Statement(Statement &&) = default;
+    Statement(const Statement &) = delete;
+    Statement &operator=(Statement &&) = default;
+};
+
+// The rewrites of the peephole pass, made with -O on straight line code
+// before the first pass:
+//
+//   push %rX; pop %rX             removed
+//   push %rX; pop %rY             ld %rX, %rY
+//   ld $k, %rX                    removed while %rX still holds k
+//   ld %rX, %rX                   removed
+//   jmp, beq, bne or bgt to the   removed
+//   next instruction
+//
+// Straight line code ends at every label and directive, so labels keep
+// their meaning and relocations are made for the code as rewritten. The
+// value left below sp by a removed push is lost, and interrupt handlers
+// are expected to restore the registers they use.
+enum PeepholeRule {
+    PUSH_POP,
+    PUSH_POP_MOVE,
+    REPEATED_LOAD,
+    SELF_MOVE,
+    BRANCH_TO_NEXT,
+    PEEPHOLE_RULES
+};
+
+extern const char *PEEPHOLE_RULE_NAMES[PEEPHOLE_RULES];
+
+// code emitted for one source line, written out with -g
+struct LineEntry {
+    unsigned int section;
+    unsigned int offset;
+    unsigned int size;
+    int line;
+};
+
+// The string and symbol tables of a binary object, made before the sections
+// are encoded so that the encoders can number their relocations.
+struct ObjectTables {
+    string strings;
+    vector<ObjectSymbol> symbols;
+    // the object symbol of each name, OBJECT_NONE for names left out
+    vector<unsigned int> index;
+    unsigned int source_file = OBJECT_NONE;
+
+    unsigned int add_string(string_view name);
+    // string table offset of a name in the symbol table
+    unsigned int name(unsigned int id) { return symbols[index[id]].name; }
 };
 
 class Assembler {
@@ -133,54 +288,121 @@ class Assembler {
     const unsigned char sp = 14;
 
     bool second_pass = false;
-    unordered_map<string, Symbol> symbol_table;
-    unordered_map<string, Section> sections;
+    // runs of the first pass so far, and the layout decisions changed in
+    // the current one
+    unsigned int pass = 0;
+    unsigned int changes = 0;
+    Interner own_names;
+    vector<Symbol> own_symbol_table;
+    unordered_map<unsigned int, Section> own_sections;
+    // encoders share the tables of the first pass and only read them
+    Interner &names = own_names;
+    // indexed by name, every name has an entry
+    vector<Symbol> &symbol_table = own_symbol_table;
+    unordered_map<unsigned int, Section> &sections = own_sections;
 
     Section *current_section = nullptr;
+    // an encoder's copy of the section it encodes
+    Section encoded;
     unsigned int lc = 0;
+    // the open pool of the current section
+    unsigned int pool_index = 0;
+    // the last code emitted was an instruction, after which control does
+    // not fall through for an unconditional jump
+    bool after_code = false;
+    bool after_jump = false;
+    unsigned int line_start = 0;
+    vector<LineEntry> line_table;
+    deque<Statement> program;
+
+    void peephole();
+    void execute(Statement &statement);
+    void place_pool(size_t index);
+    void put_pool(bool branch);
+    void finish_section();
+    void make_object_tables(ObjectTables &tables);
 
   public:
-    void label(string name);
-    void global(vector<string> symbols);
-    void extern_directive(vector<string> symbols);
-    void section(string name);
-    void word(string symbol);
+    string source_file_name;
+    bool line_info = false;
+    // writes the old text format instead of a binary object
+    bool text_output = false;
+    // runs the peephole pass, counting how often each rule applied
+    bool optimize = false;
+    unsigned long rewrites[PEEPHOLE_RULES] = {};
+    // encoder threads of the second pass, 0 for one per hardware thread
+    unsigned int threads = 0;
+
+    Assembler() {}
+    // an encoder for one section in the second pass
+    Assembler(Assembler &first_pass);
+
+    unsigned int intern(string_view name);
+    void add(Statement statement) { program.push_back(move(statement)); }
+    void assemble(ostream &output);
+
+    void line_end(int line, bool is_code);
+    void label(unsigned int name);
+    void global(const vector<unsigned int> &symbols);
+    void section(unsigned int name);
+    void word(unsigned int symbol);
     void word(int literal);
     void skip(int bytes_to_skip);
+    void vectors(const vector<unsigned int> &handlers);
+    void ltorg();
     void end();
 
     void halt_instruction();
     void int_instruction();
     void iret_instruction();
     void ret_instruction();
-    void call_instruction(Instruction instruction);
-    void jmp_instruction(Instruction instruction);
-    void beq_instruction(Instruction instruction);
-    void bne_instruction(Instruction instruction);
-    void bgt_instruction(Instruction instruction);
+    void call_instruction(const Instruction &instruction);
+    void jmp_instruction(const Instruction &instruction);
+    void beq_instruction(const Instruction &instruction);
+    void bne_instruction(const Instruction &instruction);
+    void bgt_instruction(const Instruction &instruction);
     void push_instruction(int reg);
     void pop_instruction(int reg);
-    void xchg_instruction(Instruction instruction);
-    void add_instruction(Instruction instruction);
-    void sub_instruction(Instruction instruction);
-    void mul_instruction(Instruction instruction);
-    void div_instruction(Instruction instruction);
-    void not_instruction(Instruction instruction);
-    void and_instruction(Instruction instruction);
-    void xor_instruction(Instruction instruction);
-    void or_instruction(Instruction instruction);
-    void shl_instruction(Instruction instruction);
-    void shr_instruction(Instruction instruction);
-    void ld_instruction(Instruction instruction);
-    void st_instruction(Instruction instruction);
-    void csrrd_instruction(Instruction instruction);
-    void csrwr_instruction(Instruction instruction);
-
-    void make_relocation(string name, int location);
-    void make_relocations();
-    void symbol_used(string symbol);
+    void xchg_instruction(const Instruction &instruction);
+    void add_instruction(const Instruction &instruction);
+    void sub_instruction(const Instruction &instruction);
+    void mul_instruction(const Instruction &instruction);
+    void div_instruction(const Instruction &instruction);
+    void not_instruction(const Instruction &instruction);
+    void and_instruction(const Instruction &instruction);
+    void xor_instruction(const Instruction &instruction);
+    void or_instruction(const Instruction &instruction);
+    void shl_instruction(const Instruction &instruction);
+    void shr_instruction(const Instruction &instruction);
+    void ld_instruction(const Instruction &instruction);
+    void st_instruction(const Instruction &instruction);
+    void csrrd_instruction(const Instruction &instruction);
+    void csrwr_instruction(const Instruction &instruction);
+
+    void make_relocation(unsigned int name, int location);
+    void relax(Instruction &instruction);
+    void literal_used(int literal);
+    void symbol_used(const Instruction &instruction);
+    int literal_offset(int literal);
+    int symbol_offset(const Instruction &instruction);
 };
 
-void print_section(Section &section);
-void print_symbol_table(unordered_map<string, Symbol> &sym_tab);
+// parses a source file into the assembler's program, defined in parser.y
+void parse(string input_file_name, Assembler &assembler);
+
+void print_section(Section &section, Interner &names, ostream &out);
+void print_symbol_table(vector<Symbol> &sym_tab, Interner &names,
+                        ostream &out);
+void print_line_table(string source_file_name, vector<LineEntry> &lines,
+                      Interner &names, ostream &out);
+void write_section(Section &section, ObjectTables &tables, string &out);
+void write_object(vector<string> &sections, ObjectTables &tables,
+                  vector<LineEntry> &lines, ostream &out);
 bool fits_12_bits(int number);
+
+// heap allocations of the threads that have exited and the calling one,
+// reported with -stats. The replaced operator new lives in its own file so
+// it is not inlined into the code that calls it.
+void allocation_totals(unsigned long &count, unsigned long &bytes);
+
+#endif
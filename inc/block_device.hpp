@@ -0,0 +1,56 @@
+#ifndef BLOCK_DEVICE_HPP
+#define BLOCK_DEVICE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "bus.hpp"
+#include "memory.hpp"
+
+using namespace std;
+
+class Emulator;
+
+const unsigned int BLOCK_DEVICE_START = 0xFFFFFF20;
+const unsigned int BLOCK_DEVICE_SIZE = 0x14;
+const unsigned int SECTOR_SIZE = 512;
+
+enum BlockRegisters {
+    BLOCK_SECTOR = 0x0,
+    BLOCK_COUNT = 0x4,
+    BLOCK_BUFFER = 0x8,
+    BLOCK_COMMAND = 0xC, // reads return the status
+    BLOCK_SECTORS = 0x10 // read-only size of the device
+};
+enum BlockCommands { BLOCK_READ = 1, BLOCK_WRITE };
+enum BlockStatus { BLOCK_IDLE, BLOCK_BUSY, BLOCK_DONE, BLOCK_ERROR };
+
+// Disk backed by a host file. Transfers are done by a host I/O thread so
+// the guest keeps running, completion is signalled by the BLOCK interrupt.
+class BlockDevice : public Device {
+  private:
+    Memory *mem;
+    Emulator *core;
+    int fd;
+    unsigned int sectors;
+    unsigned int sector = 0;
+    unsigned int count = 0;
+    unsigned int buffer = 0;
+    unsigned int command = 0;
+    atomic<unsigned int> status{BLOCK_IDLE};
+    mutex registers_mutex;
+    condition_variable command_written;
+
+    void work();
+    bool transfer(unsigned int command, unsigned int sector,
+                  unsigned int count, unsigned int buffer);
+
+  public:
+    BlockDevice(Memory *mem, Emulator *core, string file_name);
+    unsigned int read_register(unsigned int offset) override;
+    void write_register(unsigned int offset, unsigned int value) override;
+};
+
+#endif
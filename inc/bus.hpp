@@ -0,0 +1,50 @@
+#ifndef BUS_HPP
+#define BUS_HPP
+
+#include <string>
+#include <vector>
+
+#include "memory.hpp"
+
+using namespace std;
+
+class Device {
+  public:
+    virtual unsigned int read_register(unsigned int offset) = 0;
+    virtual void write_register(unsigned int offset, unsigned int value) = 0;
+    // called between instructions while a DEVICE_TICK is pending
+    virtual void tick() {}
+};
+
+struct Region {
+    unsigned int start;
+    unsigned int size;
+    Device *device;
+    string name;
+    unsigned long accesses = 0;
+};
+
+// Routes accesses above MMIO_START to the devices mapped there. Devices can
+// only live in that window, so RAM accesses never look at the region table.
+class Bus {
+  private:
+    Memory *mem;
+    vector<Region> regions;
+
+    Region *find(unsigned int address);
+
+  public:
+    unsigned long accesses = 0;
+
+    Bus(Memory *mem) : mem(mem) {}
+    void map(unsigned int start, unsigned int size, Device *device,
+             string name);
+    void tick();
+    void report(unsigned long ram_accesses);
+    vector<Region> &mapped_regions() { return regions; }
+
+    unsigned int read_word(unsigned int address);
+    void write_word(unsigned int address, unsigned int value);
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef COSIMULATION_HPP
+#define COSIMULATION_HPP
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Emulator;
+
+string disassemble(unsigned int word);
+
+// Runs the fast engine and the reference interpreter in lockstep on separate
+// copies of guest memory. After every block of the fast engine the reference
+// retires the same number of instructions, then registers, CSRs and the
+// streams of memory writes are compared.
+class Cosimulation {
+  private:
+    Emulator *reference;
+    Emulator *fast;
+    vector<pair<unsigned int, unsigned int>> reference_writes;
+    vector<pair<unsigned int, unsigned int>> fast_writes;
+
+    template <class Policy> bool lockstep();
+    bool matches();
+    void report_divergence(unsigned int block_address, unsigned int executed);
+
+  public:
+    unsigned long blocks = 0;
+    unsigned long instructions = 0;
+
+    Cosimulation(Emulator *reference, Emulator *fast);
+    // returns false at the first divergence
+    bool run();
+};
+
+#endif
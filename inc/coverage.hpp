@@ -0,0 +1,45 @@
+#ifndef COVERAGE_HPP
+#define COVERAGE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "memory.hpp"
+
+using namespace std;
+
+// code at [address, address + size) comes from line of source_file
+struct SourceLine {
+    unsigned int address;
+    unsigned int size;
+    int line;
+    string source_file;
+};
+
+vector<SourceLine> read_line_table(string lines_file_name);
+// without line info every line of the hex file stands for its bytes
+vector<SourceLine> hex_line_table(string hex_file_name);
+
+// Records executed instructions and the outcomes of conditional jumps in
+// maps holding one byte per guest word. Reserved like guest memory and
+// backed lazily, a record is a single store of 1 so cores never race.
+class Coverage {
+  private:
+    unsigned char *executed_words;
+    unsigned char *taken_words;
+    unsigned char *not_taken_words;
+
+  public:
+    Coverage();
+    void report(string output_file_name, Memory *mem,
+                vector<SourceLine> &lines, map<string, unsigned int> &symbols);
+
+    void executed(unsigned int address) { executed_words[address >> 2] = 1; }
+
+    void branch(unsigned int address, bool taken) {
+        (taken ? taken_words : not_taken_words)[address >> 2] = 1;
+    }
+};
+
+#endif
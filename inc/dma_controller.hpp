@@ -0,0 +1,53 @@
+#ifndef DMA_CONTROLLER_HPP
+#define DMA_CONTROLLER_HPP
+
+#include <mutex>
+
+#include "bus.hpp"
+#include "memory.hpp"
+
+using namespace std;
+
+class Emulator;
+
+const unsigned int DMA_START = 0xFFFFFF40;
+const unsigned int DMA_SIZE = 0x10;
+
+enum DmaRegisters {
+    DMA_SOURCE = 0x0, // fill value when DMA_FILL is set
+    DMA_DESTINATION = 0x4,
+    DMA_LENGTH = 0x8,
+    DMA_CONTROL = 0xC // reads return the status
+};
+enum DmaControl { DMA_GO = 0x1, DMA_FILL = 0x2 };
+enum DmaStatus { DMA_IDLE, DMA_BUSY, DMA_DONE, DMA_ERROR };
+
+// Copies or fills guest memory with host memmove/memset and raises the DMA
+// interrupt when done. With a rate the transfer moves that many bytes per
+// instruction executed by the interrupted core instead of completing at once.
+class DmaController : public Device {
+  private:
+    Memory *mem;
+    Emulator *core;
+    unsigned int rate;
+    unsigned int source = 0;
+    unsigned int destination = 0;
+    unsigned int length = 0;
+    unsigned int transferred = 0;
+    bool fill = false;
+    bool backwards = false;
+    unsigned int status = DMA_IDLE;
+    mutex registers_mutex;
+
+    void start(unsigned int control);
+    void transfer(unsigned int bytes);
+
+  public:
+    DmaController(Memory *mem, Emulator *core, unsigned int rate)
+        : mem(mem), core(core), rate(rate) {}
+    unsigned int read_register(unsigned int offset) override;
+    void write_register(unsigned int offset, unsigned int value) override;
+    void tick() override;
+};
+
+#endif
@@ -1,37 +1,148 @@
+#include <atomic>
+#include <csetjmp>
+#include <csignal>
+#include <iostream>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "block_device.hpp"
+#include "bus.hpp"
+#include "coverage.hpp"
+#include "dma_controller.hpp"
+#include "fast_engine.hpp"
+#include "fuzzer.hpp"
+#include "hooks.hpp"
+#include "instrumentation.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "semihosting.hpp"
+#include "server.hpp"
+#include "timing.hpp"
+
 using namespace std;
 
+enum Csrs { STATUS, HANDLE, CAUSE, INSTRET, CYCLE, INTCOUNT, COREID, IPI };
+// DEVICE_TICK is never seen by the guest, it lets devices that progress with
+// simulated time run between instructions while they are busy
+enum Causes {
+    DEVICE_TICK,
+    INVALID,
+    TIMER,
+    TERMINAL,
+    SOFTWARE,
+    INTERPROCESSOR,
+    BLOCK,
+    DMA,
+    MEMORY_FAULT
+};
+
+// status bit for vectored interrupts, handle then points to a table with
+// the handler address of each cause
+const unsigned int VECTORED = 0x8;
+
 class Emulator {
+    friend class FastEngine;
+    friend class Cosimulation;
+    friend class Fuzzer;
+
   private:
-    unordered_map<unsigned int, unsigned char> mem;
+    Memory *mem;
+    vector<Emulator *> *cores;
+    atomic<unsigned int> pending_interrupts{0};
+    bool running = false;
+    sigjmp_buf fault_jump;
+    unsigned int fault_address;
+    // set before each instruction is fetched, so a guard fault knows which
+    // one to stop at or restart
+    unsigned int instruction_address = 0;
+    bool in_guard_fault = false;
     unsigned int gpr[16];
-    unsigned int csr[3];
+    unsigned int csr[16];
     unsigned int &pc = gpr[15];
     unsigned int &sp = gpr[14];
     unsigned int &status = csr[0];
     unsigned int &handle = csr[1];
     unsigned int &cause = csr[2];
+    unsigned int &instret = csr[3];
+    unsigned int &cycle = csr[4];
+    unsigned int &intcount = csr[5];
+    unsigned int &coreid = csr[6];
 
   public:
-    Emulator() {}
-    void load_memory(string input_file_name);
+    TimingModel *timing = nullptr;
+    Semihosting *semihosting = nullptr;
+    Hooks *hooks = nullptr;
+    Coverage *coverage = nullptr;
+    EdgeMap *edges = nullptr;
+    FastEngine *engine = nullptr;
+    Bus *bus;
+    // counted only while count_accesses is set
+    unsigned long ram_accesses = 0;
+    bool count_accesses = false;
+    CoreMetrics metrics;
+    // guest RAM writes as (address, value), recorded for co-simulation
+    vector<pair<unsigned int, unsigned int>> *write_log = nullptr;
+    bool guard_trap = false;
+    bool faulted = false;
+    unsigned int start_address = 0x40000000;
+    // checked between instructions, or between blocks of the fast engine
+    unsigned long instruction_limit = ~0UL;
+
+    Emulator(Memory *mem, Bus *bus, vector<Emulator *> *cores,
+             unsigned int id)
+        : mem(mem), cores(cores), bus(bus) {
+        for (int i = 0; i < 16; i++) {
+            gpr[i] = 0;
+        }
+        for (int i = 0; i < 16; i++) {
+            csr[i] = 0;
+        }
+        coreid = id;
+    }
     void run();
-    void print_state();
-
-    void execute_instruction();
-    void int_instruction();
-    void call_instruction(vector<unsigned char> &bytes);
-    void jmp_instruction(vector<unsigned char> &bytes);
-    void xchg_instruction(vector<unsigned char> &bytes);
-    void arit_instruction(vector<unsigned char> &bytes);
-    void log_instruction(vector<unsigned char> &bytes);
-    void sh_instruction(vector<unsigned char> &bytes);
-    void st_instruction(vector<unsigned char> &bytes);
-    void ld_instruction(vector<unsigned char> &bytes);
-    void invalid_instruction();
+    void resume();
+    bool run_to(unsigned int address);
+    void print_state(ostream &out = cout);
+    bool is_running() { return running; }
+    void raise_interrupt(unsigned int interrupt_cause);
+    void send_ipi(unsigned int target);
+    void guard_fault();
+    static void fault_handler(int, siginfo_t *info, void *);
+
+    // used by native hooks, arguments are counted from the last one pushed
+    unsigned int hook_argument(int index);
+    void hook_return(unsigned int result);
+
+    // branch on the runtime features one at a time, down to the loop
+    // specialized for all of them
+    template <bool... chosen> void select_loop();
+    template <class Policy> void run_loop();
+
+    // Policy is an Instrumentation, see instrumentation.hpp
+    template <class Policy> void execute_instruction();
+    template <class Policy> void execute_word(unsigned int word);
+    template <class Policy> void hook_instruction(unsigned int word);
+    template <class Policy> void int_instruction();
+    template <class Policy>
+    void call_instruction(DecodedInstruction &instruction);
+    template <class Policy>
+    void jmp_instruction(DecodedInstruction &instruction);
+    template <class Policy>
+    void xchg_instruction(DecodedInstruction &instruction);
+    template <class Policy>
+    void arit_instruction(DecodedInstruction &instruction);
+    template <class Policy>
+    void log_instruction(DecodedInstruction &instruction);
+    template <class Policy>
+    void sh_instruction(DecodedInstruction &instruction);
+    template <class Policy>
+    void st_instruction(DecodedInstruction &instruction);
+    template <class Policy>
+    void ld_instruction(DecodedInstruction &instruction);
+    template <class Policy> void invalid_instruction();
+    template <class Policy> void accept_interrupt();
+    template <class Policy> void interrupt(unsigned int interrupt_cause);
 
     void set_gpr(int index, unsigned int value) {
         if (index != 0) {
@@ -39,44 +150,101 @@ class Emulator {
         }
     }
 
-    void push(unsigned int value) {
-        for (int i = sizeof(unsigned int) - 1; i >= 0; i--) {
-            sp--;
-            unsigned char byte = (value >> (i * 8)) & 0xFF;
-            mem[sp] = byte;
+    // performance counters and the core id are read-only for the guest,
+    // writing a core id to %ipi interrupts that core
+    void set_csr(int index, unsigned int value) {
+        if (index <= CAUSE) {
+            csr[index] = value;
+        } else if (index == IPI) {
+            send_ipi(value);
         }
     }
 
-    unsigned int pop() {
-        unsigned int value = 0;
-        for (int i = 0; i < sizeof(unsigned int); i++) {
-            unsigned char byte = mem[sp];
-            value |= ((unsigned int)(byte) << (i * 8));
-            sp++;
+    // records the outcome of the conditional jump that was just fetched
+    template <class Policy> bool branch(bool taken) {
+        if constexpr (Policy::covered) {
+            coverage->branch(pc - 4, taken);
+        }
+        return taken;
+    }
+
+    template <class Policy> void push(unsigned int value) {
+        if constexpr (Policy::timed) {
+            timing->data_access(sp - sizeof(unsigned int));
+        }
+        // sp only moves once the write is done, a guard fault leaves it
+        unsigned int address = sp - sizeof(unsigned int);
+        if constexpr (Policy::counted) {
+            ram_accesses++;
+        }
+        mem->write_word(address, value);
+        mem->stored(address);
+        sp = address;
+        if constexpr (Policy::logged) {
+            write_log->push_back({sp, value});
         }
-        return value;
     }
 
-    unsigned int read_word(unsigned int address) {
-        unsigned int value = 0;
-        for (int i = 0; i < sizeof(unsigned int); i++) {
-            unsigned char byte = mem[address];
-            value |= ((unsigned int)(byte) << (i * 8));
-            address++;
+    template <class Policy> unsigned int pop() {
+        if constexpr (Policy::timed) {
+            timing->data_access(sp);
         }
+        if constexpr (Policy::counted) {
+            ram_accesses++;
+        }
+        unsigned int value = mem->read_word(sp);
+        sp += sizeof(unsigned int);
         return value;
     }
 
+    template <class Policy> unsigned int read_word(unsigned int address) {
+        if constexpr (Policy::timed) {
+            timing->data_access(address);
+        }
+        if (__builtin_expect(address >= MMIO_START, 0)) {
+            return bus->read_word(address);
+        }
+        if constexpr (Policy::counted) {
+            ram_accesses++;
+        }
+        return mem->read_word(address);
+    }
+
+    template <class Policy>
     void write_word(unsigned int address, unsigned int value) {
-        for (int i = 0; i < sizeof(unsigned int); i++) {
-            unsigned char byte = (value >> (i * 8)) & 0xFF;
-            mem[address] = byte;
-            address++;
+        if constexpr (Policy::timed) {
+            timing->data_access(address);
+        }
+        if (__builtin_expect(address >= MMIO_START, 0)) {
+            bus->write_word(address, value);
+            return;
+        }
+        if constexpr (Policy::counted) {
+            ram_accesses++;
+        }
+        mem->write_word(address, value);
+        mem->stored(address);
+        if constexpr (Policy::logged) {
+            write_log->push_back({address, value});
         }
     }
 };
 
-enum Instructions { HALT, INT, CALL, JUMP, XCHG, ARIT, LOG, SH, ST, LD };
+// HOOK is never emitted by the assembler, the emulator patches it over the
+// first instruction of guest functions replaced by native hooks
+enum Instructions {
+    HALT,
+    INT,
+    CALL,
+    JUMP,
+    XCHG,
+    ARIT,
+    LOG,
+    SH,
+    ST,
+    LD,
+    HOOK = 15
+};
 enum Calls { CALL_DIR, CALL_IND };
 enum Jumps { JMP, JEQ, JNE, JGT, BRANCH = 8, BEQ, BNE, BGT };
 enum Aritmethic { ADD, SUB, MUL, DIV };
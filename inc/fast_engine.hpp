@@ -0,0 +1,70 @@
+#ifndef FAST_ENGINE_HPP
+#define FAST_ENGINE_HPP
+
+#include <unordered_map>
+#include <vector>
+
+#include "instrumentation.hpp"
+#include "memory.hpp"
+
+using namespace std;
+
+class Emulator;
+
+struct DecodedInstruction {
+    unsigned int word;
+    // opcode and mode, as in the first byte of the instruction
+    unsigned char operation;
+    unsigned char a;
+    unsigned char b;
+    unsigned char c;
+    int d;
+};
+
+inline DecodedInstruction decode(unsigned int word) {
+    DecodedInstruction instruction;
+    instruction.word = word;
+    instruction.operation = word & 0xFF;
+    instruction.a = (word >> 12) & 0x0F;
+    instruction.b = (word >> 8) & 0x0F;
+    instruction.c = (word >> 20) & 0x0F;
+    instruction.d = ((word >> 8) & 0xF00) | (word >> 24);
+    if (instruction.d & 0x800) {
+        instruction.d |= 0xFFFFF000;
+    }
+    return instruction;
+}
+
+// straight-line run of instructions ending at the first one that can transfer
+// control on its own
+struct Block {
+    vector<DecodedInstruction> instructions;
+};
+
+// Executes guest code from blocks that are decoded once and cached by
+// address. Instructions that are rare or have side effects outside the core
+// (int, hooks, invalid encodings) are handed to the reference interpreter.
+class FastEngine {
+  private:
+    Emulator &core;
+    Memory *mem;
+    unordered_map<unsigned int, Block> blocks;
+    unsigned int generation;
+    // where the current block started, for abandon_block
+    unsigned int block_address = 0;
+    unsigned long block_instret = 0;
+
+    Block &lookup(unsigned int address);
+    void flush();
+    template <class Policy> bool execute(DecodedInstruction &instruction);
+    template <class Policy>
+    bool store(unsigned int address, unsigned int value);
+
+  public:
+    FastEngine(Emulator &core, Memory *mem);
+    // returns the number of instructions retired
+    template <class Policy> unsigned int execute_block();
+    void abandon_block();
+};
+
+#endif
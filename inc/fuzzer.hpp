@@ -0,0 +1,60 @@
+#ifndef FUZZER_HPP
+#define FUZZER_HPP
+
+#include <string>
+
+using namespace std;
+
+class Emulator;
+
+// size of the AFL coverage bitmap
+const unsigned int EDGE_MAP_SIZE = 1 << 16;
+
+// AFL style edge coverage, a hit counter for each hashed pair of consecutive
+// blocks
+struct EdgeMap {
+    unsigned char *bitmap;
+    unsigned int previous = 0;
+
+    void visit(unsigned int address) {
+        unsigned int location = ((address >> 2) * 0x9E3779B1U) >> 16;
+        bitmap[location ^ previous]++;
+        previous = location >> 1;
+    }
+};
+
+// Runs the image to the entry point once, snapshots memory and registers,
+// then runs one test case per fuzzer input from that state. The input is
+// written to the guest buffer as a length word followed by the bytes. A case
+// ends at halt or after the instruction budget, and is a crash when it
+// faults on a guard page or raises an invalid instruction or memory fault.
+//
+// With AFL's fork server pipes open the cases run in persistent mode: each
+// forked child runs up to iterations cases, stopping itself between them.
+// Otherwise a single case runs, which is how crashes are reproduced.
+class Fuzzer {
+  private:
+    Emulator *core = nullptr;
+    unsigned int saved_gpr[16];
+    unsigned int saved_csr[16];
+    EdgeMap edges;
+
+    unsigned int read_input();
+    bool run_case();
+    void serve();
+
+  public:
+    unsigned int entry = 0;
+    unsigned int buffer = 0;
+    unsigned int buffer_size = 0;
+    // read from stdin when empty
+    string input_file_name;
+    unsigned long budget = 1000000;
+    unsigned int iterations = 1000;
+
+    // returns true if the standalone case crashed, never returns when
+    // serving a fork server
+    bool run(Emulator *core);
+};
+
+#endif
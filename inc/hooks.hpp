@@ -0,0 +1,44 @@
+#ifndef HOOKS_HPP
+#define HOOKS_HPP
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "memory.hpp"
+
+using namespace std;
+
+class Emulator;
+
+// returns false to leave the call to the guest code, before changing anything
+typedef bool (*NativeFunction)(Emulator &emulator);
+
+// reads the "name address" lines written by the linker's -map option
+map<string, unsigned int> read_symbol_map(string map_file_name);
+
+struct Hook {
+    string name;
+    unsigned int address;
+    unsigned int original;
+    NativeFunction native;
+    atomic<unsigned long> calls{0};
+    atomic<unsigned long> mismatches{0};
+};
+
+class Hooks {
+  private:
+    map<string, unsigned int> symbols;
+
+  public:
+    vector<Hook *> hooks;
+    bool verify = false;
+
+    void load_symbols(string map_file_name);
+    void install(Memory *mem, string name);
+    void install(Memory *mem, string name, unsigned int address);
+    void report();
+};
+
+#endif
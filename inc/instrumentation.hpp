@@ -0,0 +1,30 @@
+#ifndef INSTRUMENTATION_HPP
+#define INSTRUMENTATION_HPP
+
+// Selects at compile time what a specialization of the interpreter records.
+// Checks for disabled features sit behind if constexpr, so a loop without
+// instrumentation pays nothing for it. Emulator::resume picks the loop once
+// from what the core was set up with.
+template <bool timing, bool coverage, bool logging, bool counting>
+struct Instrumentation {
+    // feed the timing model
+    static constexpr bool timed = timing;
+    // mark executed words and conditional jump outcomes
+    static constexpr bool covered = coverage;
+    // append guest RAM writes to write_log
+    static constexpr bool logged = logging;
+    // count guest RAM accesses for -bus-stats
+    static constexpr bool counted = counting;
+};
+
+// the combinations the fast engine supports, it has no timing model
+using Plain = Instrumentation<false, false, false, false>;
+using Covered = Instrumentation<false, true, false, false>;
+using Logged = Instrumentation<false, false, true, false>;
+using CoveredLogged = Instrumentation<false, true, true, false>;
+using Counted = Instrumentation<false, false, false, true>;
+using CoveredCounted = Instrumentation<false, true, false, true>;
+using LoggedCounted = Instrumentation<false, false, true, true>;
+using CoveredLoggedCounted = Instrumentation<false, true, true, true>;
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include <string>
+
+#include "assembler.hpp"
+#include "parser.tab.hpp"
+
+using namespace std;
+
+// Scans a source file mapped into memory. Words are views into the mapping
+// until they are interned, reserved words are found with a perfect hash
+// computed at compile time.
+class Lexer {
+  private:
+    Assembler &assembler;
+    const char *source = nullptr;
+    size_t size = 0;
+    const char *cursor = nullptr;
+    const char *end = nullptr;
+
+    void skip_blanks();
+
+  public:
+    // counts the line ends returned so far
+    int line = 0;
+
+    Lexer(string file_name, Assembler &assembler);
+    ~Lexer();
+
+    int next(YYSTYPE *value);
+};
+
+#endif
@@ -1,8 +1,11 @@
+#include <fstream>
 #include <map>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "object_file.hpp"
+
 using namespace std;
 
 struct Symbol {
@@ -19,6 +22,13 @@ struct Relocation {
     string symbol;
 };
 
+struct LineEntry {
+    string section_name;
+    unsigned int offset;
+    unsigned int size;
+    int line;
+};
+
 struct Section {
     vector<unsigned char> content;
     vector<Relocation> relocations;
@@ -34,15 +44,23 @@ class Linker {
     unordered_map<string, vector<Section>> sections;
     unordered_map<string, Symbol> symbol_table;
     unordered_map<string, Section> out_sections;
+    // present for files assembled with -g
+    unordered_map<string, string> source_files;
+    unordered_map<string, vector<LineEntry>> line_tables;
 
   public:
     void read_files(vector<string> files);
+    void read_object(const char *data, size_t size, string file_name);
+    void read_text_file(string file_name);
+    void read_line_table(ifstream &file, string file_name);
     void check_for_undefined_symbols();
     void place_sections(map<unsigned int, string> place_options,
                         vector<string> files);
     void update_symbols();
     void relocate();
     void output(string output_file_name);
+    void output_map(string map_file_name);
+    void output_lines(string lines_file_name);
 
     void add_symbol(Symbol symbol);
     Section *get_section(string file_name, string section_name);
@@ -0,0 +1,163 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// guest RAM ends where the memory-mapped registers start
+const unsigned int MMIO_START = 0xFFFFFF00;
+// granularity at which predecoded guest code is tracked
+const unsigned int CODE_LINE_SHIFT = 8;
+
+// contents of a hex file as runs of consecutive bytes
+struct Image {
+    vector<pair<unsigned int, vector<unsigned char>>> segments;
+};
+
+Image parse_image(string &text);
+
+// Guest memory shared by all cores. The whole 32-bit address space is
+// reserved up front and backed lazily by the host, so an access is a plain
+// load or store at base + address. Aligned word accesses are single-copy
+// atomic with acquire/release ordering; unaligned ones are copied bytewise.
+//
+// Guard regions are made inaccessible with host page protection, so guest
+// accesses pay no bounds checks and a stray access faults in the host.
+class Memory {
+  private:
+    unsigned char *base;
+    unsigned long page_size;
+    vector<bool> loaded_pages;
+    // sorted, disjoint, page aligned [start, end) ranges
+    vector<pair<unsigned long, unsigned long>> guards;
+    // snapshot state, pages are saved to the shadow mapping on their first
+    // write after the snapshot
+    unsigned char *shadow = nullptr;
+    vector<unsigned char> saved_pages;
+    unsigned int *dirty_pages = nullptr;
+    unsigned long dirty_count = 0;
+
+    bool is_guarded(unsigned long address) {
+        auto after = upper_bound(guards.begin(), guards.end(),
+                                 make_pair(address, ~0UL));
+        return after != guards.begin() && address < prev(after)->second;
+    }
+
+  public:
+    // lines holding predecoded code, empty unless a fast engine is in use.
+    // Writing to a marked line bumps code_generation so that fast engines
+    // drop their decoded blocks.
+    vector<unsigned char> code_lines;
+    atomic<unsigned int> code_generation{0};
+
+    Memory();
+    ~Memory();
+    void load_memory(string input_file_name);
+    void load_image(Image &image);
+    void protect(unsigned long start, unsigned long size);
+    void protect_unmapped(vector<pair<unsigned long, unsigned long>> &mapped);
+    void snapshot();
+    bool write_fault(void *host_address);
+    void restore();
+
+    bool has_guards() { return !guards.empty(); }
+
+    bool contains(void *host_address) {
+        return (unsigned char *)host_address >= base &&
+               (unsigned long)((unsigned char *)host_address - base) <
+                   (1UL << 32);
+    }
+
+    unsigned int guest_address(void *host_address) {
+        return (unsigned char *)host_address - base;
+    }
+
+    // guest RAM that can be used by host-side bulk operations
+    bool is_mapped(unsigned int address, unsigned int length) {
+        if ((unsigned long)address + length > MMIO_START) {
+            return false;
+        }
+        for (auto &guard : guards) {
+            if (address < guard.second &&
+                guard.first < (unsigned long)address + length) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    unsigned int mapped_length(unsigned int address) {
+        unsigned long end = MMIO_START;
+        for (auto &guard : guards) {
+            if (guard.second > address) {
+                end = min(end, max(guard.first, (unsigned long)address));
+                break;
+            }
+        }
+        return address < end ? end - address : 0;
+    }
+
+    unsigned char *host_address(unsigned int address) { return base + address; }
+
+    void track_code() { code_lines.resize(1UL << (32 - CODE_LINE_SHIFT)); }
+
+    void mark_code(unsigned int address) {
+        __atomic_store_n(&code_lines[address >> CODE_LINE_SHIFT], 1,
+                         __ATOMIC_RELAXED);
+    }
+
+    bool is_code(unsigned int address) {
+        return __atomic_load_n(&code_lines[address >> CODE_LINE_SHIFT],
+                               __ATOMIC_RELAXED);
+    }
+
+    // called after every guest store, the word may have been decoded
+    void stored(unsigned int address) {
+        if (!code_lines.empty() &&
+            (is_code(address) || is_code(address + 3))) {
+            code_generation++;
+        }
+    }
+
+    // called by host-side bulk writers after they change guest memory
+    void modified(unsigned int address, unsigned long length) {
+        if (code_lines.empty() || length == 0) {
+            return;
+        }
+        unsigned long last = (address + length - 1) >> CODE_LINE_SHIFT;
+        for (unsigned long line = address >> CODE_LINE_SHIFT; line <= last;
+             line++) {
+            if (is_code(line << CODE_LINE_SHIFT)) {
+                code_generation++;
+                return;
+            }
+        }
+    }
+
+    unsigned int read_word(unsigned int address) {
+        unsigned int value;
+        if (address & 0x3) {
+            memcpy(&value, base + address, sizeof(unsigned int));
+        } else {
+            value = __atomic_load_n((unsigned int *)(base + address),
+                                    __ATOMIC_ACQUIRE);
+        }
+        return value;
+    }
+
+    void write_word(unsigned int address, unsigned int value) {
+        if (address & 0x3) {
+            memcpy(base + address, &value, sizeof(unsigned int));
+        } else {
+            __atomic_store_n((unsigned int *)(base + address), value,
+                             __ATOMIC_RELEASE);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class Emulator;
+class Bus;
+
+// Counters kept by every core. Each one is written only by the thread running
+// the core, so an increment is a plain load and store, and the reporter
+// thread reads them with relaxed loads.
+struct CoreMetrics {
+    unsigned long instructions = 0;
+    unsigned long interrupts[16] = {};
+    unsigned long block_hits = 0;
+    unsigned long block_misses = 0;
+    unsigned long block_flushes = 0;
+};
+
+inline void count(unsigned long &counter, unsigned long amount = 1) {
+    __atomic_store_n(&counter, counter + amount, __ATOMIC_RELAXED);
+}
+
+inline unsigned long read_counter(unsigned long &counter) {
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+// Periodically renders the counters in the Prometheus text format to a file,
+// and serves them to clients of a Unix socket, from its own thread.
+class MetricsReporter {
+  private:
+    vector<Emulator *> *cores;
+    Bus *bus;
+    thread reporter;
+    int stop_pipe[2];
+    int listen_fd = -1;
+    vector<unsigned long> last_instructions;
+    vector<double> mips;
+
+    void run();
+    void update(double seconds);
+    string render();
+    void write_file();
+    void serve(int client_fd);
+
+  public:
+    string file_name;
+    string socket_name;
+    unsigned int interval = 1000;
+
+    MetricsReporter(vector<Emulator *> *cores, Bus *bus);
+    void start();
+    void stop();
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef OBJECT_FILE_HPP
+#define OBJECT_FILE_HPP
+
+#include <cstdint>
+
+using namespace std;
+
+// Binary relocatable objects, written by the assembler and mapped by the
+// linker. Every field is a 32 bit word in host byte order and every part
+// starts on a word boundary:
+//
+//   header
+//   string table, the NUL terminated names padded to a word
+//   symbol_count symbol records
+//   section_count times a section record, its padded content and its
+//   relocation records
+//   line_count line records
+//
+// Names and sections are string table offsets, relocations name an entry of
+// the symbol table. Besides the global symbols the table holds every
+// undefined symbol and every section, so that each relocation has one.
+
+const char OBJECT_MAGIC[4] = {'S', 'O', 'B', 'J'};
+const uint32_t OBJECT_VERSION = 1;
+
+// symbol flags
+const uint32_t OBJECT_GLOBAL = 1 << 0;
+const uint32_t OBJECT_DEFINED = 1 << 1;
+// section of an undefined symbol and source file of an object without a
+// line table
+const uint32_t OBJECT_NONE = -1;
+
+struct ObjectHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t string_table_size;
+    uint32_t symbol_count;
+    uint32_t section_count;
+    uint32_t line_count;
+    uint32_t source_file;
+};
+
+struct ObjectSymbol {
+    uint32_t name;
+    uint32_t value;
+    uint32_t section;
+    uint32_t flags;
+};
+
+struct ObjectSection {
+    uint32_t name;
+    uint32_t length;
+    uint32_t relocation_count;
+};
+
+struct ObjectRelocation {
+    uint32_t offset;
+    int32_t addend;
+    uint32_t symbol;
+};
+
+struct ObjectLine {
+    uint32_t section;
+    uint32_t offset;
+    uint32_t size;
+    int32_t line;
+};
+
+inline uint32_t object_align(uint32_t size) { return (size + 3) & ~3U; }
+
+#endif
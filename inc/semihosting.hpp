@@ -0,0 +1,42 @@
+#ifndef SEMIHOSTING_HPP
+#define SEMIHOSTING_HPP
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "memory.hpp"
+
+using namespace std;
+
+// Semihosting convention: with -semihosting, an int executed while %r1
+// holds SEMIHOSTING_MAGIC | service is handled by the host instead of
+// raising a software interrupt. %r2 points to the word arguments of the
+// service and the result is returned in %r1 (0xFFFFFFFF on error).
+const unsigned int SEMIHOSTING_MAGIC = 0x5E4D0000;
+
+enum Services {
+    SYS_COPY = 1, // dst, src, len
+    SYS_FILL,     // dst, byte, len
+    SYS_COMPARE,  // a, b, len -> -1, 0 or 1
+    SYS_STRLEN,   // str -> length
+    SYS_OPEN,     // path, mode (0 read, 1 write, 2 append) -> handle
+    SYS_READ,     // handle, buf, len -> bytes read
+    SYS_WRITE,    // handle, buf, len -> bytes written
+    SYS_CLOSE     // handle
+};
+
+class Semihosting {
+  private:
+    // handles 0, 1 and 2 are the emulator's stdin, stdout and stderr
+    vector<FILE *> files = {stdin, stdout, stderr};
+    mutex files_mutex;
+
+    FILE *get_file(unsigned int handle);
+
+  public:
+    unsigned int call(Memory *mem, unsigned int service,
+                      unsigned int arguments);
+};
+
+#endif
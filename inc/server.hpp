@@ -0,0 +1,52 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+
+#include "memory.hpp"
+
+using namespace std;
+
+// keeps a guest that never halts from holding a worker forever
+const unsigned long DEFAULT_INSTRUCTION_LIMIT = 100000000;
+
+// Runs guest programs for clients of a Unix socket, one request per
+// connection, on a fixed pool of worker threads. Parsed images are kept in
+// memory keyed by a hash of the hex file, so repeated runs skip the parse.
+//
+// A request is a list of lines ending with "run":
+//   image <path>         hex file to run, parsed unless already cached
+//   hash <hex>           previously loaded image to run
+//   start <address>      initial pc, 0x40000000 by default
+//   limit <count>        stop after this many instructions, the server's
+//                        -server-limit by default
+//   reg <index> <value>  initial value of a general purpose register
+//   fast                 use the fast engine
+// The response starts with "ok" or "error <message>".
+class Server {
+  private:
+    string socket_name;
+    unsigned int threads;
+    unsigned long instruction_limit;
+    mutex images_mutex;
+    unordered_map<unsigned long, shared_ptr<Image>> images;
+    mutex clients_mutex;
+    condition_variable clients_ready;
+    queue<int> clients;
+
+    void worker();
+    void handle(int client_fd);
+    string execute(string &request);
+
+  public:
+    Server(string socket_name, unsigned int threads,
+           unsigned long instruction_limit);
+    void run();
+};
+
+#endif
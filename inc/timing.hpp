@@ -0,0 +1,69 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+struct CacheLine {
+    unsigned int tag = 0;
+    unsigned long last_used = 0;
+    bool valid = false;
+};
+
+class Cache {
+  public:
+    string name;
+
+  private:
+    vector<CacheLine> lines;
+    unsigned int line_size;
+    unsigned int ways;
+    unsigned int sets;
+    unsigned long clock = 0;
+
+  public:
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    unordered_map<unsigned int, unsigned long> miss_addresses;
+
+    Cache(string name, unsigned int size, unsigned int line_size,
+          unsigned int ways);
+    bool access(unsigned int address);
+    void report(int top_misses);
+};
+
+class TimingModel {
+  private:
+    unsigned int latency[16][16];
+    unsigned int miss_penalty = 10;
+    int top_misses = 10;
+
+  public:
+    Cache *icache = nullptr;
+    Cache *dcache = nullptr;
+    unsigned long cycles = 0;
+    unsigned long instructions = 0;
+
+    TimingModel();
+    void load_config(string config_file_name);
+    void report();
+
+    void fetch(unsigned int address, unsigned char opcode) {
+        instructions++;
+        cycles += latency[(opcode >> 4) & 0x0F][opcode & 0x0F];
+        if (icache && !icache->access(address)) {
+            cycles += miss_penalty;
+        }
+    }
+
+    void data_access(unsigned int address) {
+        if (dcache && !dcache->access(address)) {
+            cycles += miss_penalty;
+        }
+    }
+};
+
+#endif
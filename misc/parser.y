@@ -2,32 +2,48 @@
   #include <iostream>
   #include <string>
   #include <vector>
-  #include "assembler.hpp"
   using namespace std;
-  
-  extern int line_num;
-  extern int yylex();
-  void yyerror(const char* s);
-
-  Assembler assembler;
-  vector<string> symbol_list;
-  Instruction ins;
-  Operand op;
 %}
 
+%code requires {
+  #include "assembler.hpp"
+
+  class Lexer;
+
+  // what a parse of one source file keeps between tokens, so that files can
+  // be parsed concurrently
+  struct ParseState {
+    vector<unsigned int> symbol_list;
+    Instruction ins;
+    Operand op;
+  };
+}
+
+%code {
+  #include "lexer.hpp"
+
+  int yylex(YYSTYPE *yylval, Lexer &lexer) { return lexer.next(yylval); }
+  void yyerror(Lexer &lexer, Assembler &assembler, ParseState &,
+               const char *);
+}
+
+%define api.pure full
+%param {Lexer &lexer}
+%parse-param {Assembler &assembler} {ParseState &state}
+
 %union {
-  char* sval;
+  unsigned int symbol;
   int ival;
 }
 
 %token ENDL COMMA DOLLAR LBRACKETS RBRACKETS PLUS
-%token GLOBAL EXTERN SECTION WORD SKIP END
+%token GLOBAL EXTERN SECTION WORD SKIP VECTORS LTORG END
 %token HALT INT IRET CALL RET JMP BEQ BNE BGT
 %token PUSH POP XCHG ADD SUB MUL DIV NOT AND OR
 %token XOR SHL SHR LD ST CSRRD CSRWR
 
-%token <sval> LABEL
-%token <sval> STRING
+%token <symbol> LABEL
+%token <symbol> STRING
 %token <ival> NUMBER
 %token <ival> GPR
 %token <ival> CSR
@@ -38,75 +54,88 @@ Program:
   | Line
 
 Line:
-    Instruction ENDL
-  | Directive ENDL
-  | LABEL { assembler.label($1); } ENDL
-  | LABEL { assembler.label($1); } Instruction ENDL
-  | LABEL { assembler.label($1); } Directive ENDL
+    Instruction ENDL { assembler.add(Statement(LINE_END, lexer.line, true)); }
+  | Directive ENDL { assembler.add(Statement(LINE_END, lexer.line, false)); }
+  | Label ENDL
+  | Label Instruction ENDL { assembler.add(Statement(LINE_END, lexer.line, true)); }
+  | Label Directive ENDL { assembler.add(Statement(LINE_END, lexer.line, false)); }
   | ENDL
 
+Label:
+    LABEL { assembler.add(Statement(LABEL_STATEMENT, $1)); }
+
 Directive:
-    GLOBAL SymbolList { assembler.global(symbol_list); symbol_list.clear(); }
-  | EXTERN SymbolList { assembler.extern_directive(symbol_list); symbol_list.clear(); }
-  | SECTION STRING { assembler.section($2); }
+    GLOBAL SymbolList { assembler.add(Statement(GLOBAL_DIRECTIVE, move(state.symbol_list))); state.symbol_list.clear(); }
+  | EXTERN SymbolList { assembler.add(Statement(EXTERN_DIRECTIVE, move(state.symbol_list))); state.symbol_list.clear(); }
+  | SECTION STRING { assembler.add(Statement(SECTION_DIRECTIVE, $2)); }
   | WORD SymbolOrLiteralList
-  | SKIP NUMBER { assembler.skip($2); }
-  | END { assembler.end(); }
+  | SKIP NUMBER { assembler.add(Statement(SKIP_DIRECTIVE, $2)); }
+  | VECTORS SymbolList { assembler.add(Statement(VECTORS_DIRECTIVE, move(state.symbol_list))); state.symbol_list.clear(); }
+  | LTORG { assembler.add(Statement(LTORG_DIRECTIVE)); }
+  | END { assembler.add(Statement(END_DIRECTIVE)); }
 
 SymbolList:
-    STRING { symbol_list.push_back($1); }
-  | SymbolList COMMA STRING { symbol_list.push_back($3); }
+    STRING { state.symbol_list.push_back($1); }
+  | SymbolList COMMA STRING { state.symbol_list.push_back($3); }
 
 SymbolOrLiteralList:
-    STRING { assembler.word($1); }
-  | NUMBER { assembler.word($1); }
-  | SymbolOrLiteralList COMMA STRING { assembler.word($3); }
-  | SymbolOrLiteralList COMMA NUMBER { assembler.word($3); }
+    STRING { assembler.add(Statement(WORD_SYMBOL_DIRECTIVE, $1)); }
+  | NUMBER { assembler.add(Statement(WORD_LITERAL_DIRECTIVE, $1)); }
+  | SymbolOrLiteralList COMMA STRING { assembler.add(Statement(WORD_SYMBOL_DIRECTIVE, $3)); }
+  | SymbolOrLiteralList COMMA NUMBER { assembler.add(Statement(WORD_LITERAL_DIRECTIVE, $3)); }
 
 Instruction:
-    HALT { assembler.halt_instruction(); }
-  | INT { assembler.int_instruction(); }
-  | IRET { assembler.iret_instruction(); }
-  | CALL OperandJump { ins.operand = op; assembler.call_instruction(ins); }
-  | RET {assembler.ret_instruction(); }
-  | JMP OperandJump { ins.operand = op; assembler.jmp_instruction(ins); }
-  | BEQ GPR COMMA GPR COMMA OperandJump { ins.operand = op; ins.gpr1 = $2; ins.gpr2 = $4; assembler.beq_instruction(ins); }
-  | BNE GPR COMMA GPR COMMA OperandJump { ins.operand = op; ins.gpr1 = $2; ins.gpr2 = $4; assembler.bne_instruction(ins); }
-  | BGT GPR COMMA GPR COMMA OperandJump { ins.operand = op; ins.gpr1 = $2; ins.gpr2 = $4; assembler.bgt_instruction(ins); }
-  | PUSH GPR { assembler.push_instruction($2); }
-  | POP GPR { assembler.pop_instruction($2); }
-  | XCHG GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.xchg_instruction(ins); }
-  | ADD GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.add_instruction(ins); }
-  | SUB GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.sub_instruction(ins); }
-  | MUL GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.mul_instruction(ins); }
-  | DIV GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.div_instruction(ins); }
-  | NOT GPR { ins.gpr1 = $2; assembler.not_instruction(ins); }
-  | AND GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.and_instruction(ins); }
-  | OR GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.or_instruction(ins); }
-  | XOR GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.xor_instruction(ins); }
-  | SHL GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.shl_instruction(ins); }
-  | SHR GPR COMMA GPR { ins.gpr1 = $2; ins.gpr2 = $4; assembler.shr_instruction(ins); }
-  | LD OperandData COMMA GPR { ins.gpr1 = $4; ins.operand = op; assembler.ld_instruction(ins); }
-  | ST GPR COMMA OperandData { ins.gpr1 = $2; ins.operand = op; assembler.st_instruction(ins); }
-  | CSRRD CSR COMMA GPR { ins.csr = $2; ins.gpr1 = $4; assembler.csrrd_instruction(ins); }
-  | CSRWR GPR COMMA CSR { ins.gpr1 = $2; ins.csr = $4; assembler.csrwr_instruction(ins); };
+    HALT { assembler.add(Statement(HALT_INSTRUCTION)); }
+  | INT { assembler.add(Statement(INT_INSTRUCTION)); }
+  | IRET { assembler.add(Statement(IRET_INSTRUCTION)); }
+  | CALL OperandJump { state.ins.operand = state.op; assembler.add(Statement(CALL_INSTRUCTION, state.ins)); }
+  | RET { assembler.add(Statement(RET_INSTRUCTION)); }
+  | JMP OperandJump { state.ins.operand = state.op; assembler.add(Statement(JMP_INSTRUCTION, state.ins)); }
+  | BEQ GPR COMMA GPR COMMA OperandJump { state.ins.operand = state.op; state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(BEQ_INSTRUCTION, state.ins)); }
+  | BNE GPR COMMA GPR COMMA OperandJump { state.ins.operand = state.op; state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(BNE_INSTRUCTION, state.ins)); }
+  | BGT GPR COMMA GPR COMMA OperandJump { state.ins.operand = state.op; state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(BGT_INSTRUCTION, state.ins)); }
+  | PUSH GPR { state.ins.gpr1 = $2; assembler.add(Statement(PUSH_INSTRUCTION, state.ins)); }
+  | POP GPR { state.ins.gpr1 = $2; assembler.add(Statement(POP_INSTRUCTION, state.ins)); }
+  | XCHG GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(XCHG_INSTRUCTION, state.ins)); }
+  | ADD GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(ADD_INSTRUCTION, state.ins)); }
+  | SUB GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(SUB_INSTRUCTION, state.ins)); }
+  | MUL GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(MUL_INSTRUCTION, state.ins)); }
+  | DIV GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(DIV_INSTRUCTION, state.ins)); }
+  | NOT GPR { state.ins.gpr1 = $2; assembler.add(Statement(NOT_INSTRUCTION, state.ins)); }
+  | AND GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(AND_INSTRUCTION, state.ins)); }
+  | OR GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(OR_INSTRUCTION, state.ins)); }
+  | XOR GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(XOR_INSTRUCTION, state.ins)); }
+  | SHL GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(SHL_INSTRUCTION, state.ins)); }
+  | SHR GPR COMMA GPR { state.ins.gpr1 = $2; state.ins.gpr2 = $4; assembler.add(Statement(SHR_INSTRUCTION, state.ins)); }
+  | LD OperandData COMMA GPR { state.ins.gpr1 = $4; state.ins.operand = state.op; assembler.add(Statement(LD_INSTRUCTION, state.ins)); }
+  | ST GPR COMMA OperandData { state.ins.gpr1 = $2; state.ins.operand = state.op; assembler.add(Statement(ST_INSTRUCTION, state.ins)); }
+  | CSRRD CSR COMMA GPR { state.ins.csr = $2; state.ins.gpr1 = $4; assembler.add(Statement(CSRRD_INSTRUCTION, state.ins)); }
+  | CSRWR GPR COMMA CSR { state.ins.gpr1 = $2; state.ins.csr = $4; assembler.add(Statement(CSRWR_INSTRUCTION, state.ins)); };
 
 OperandData:
-    DOLLAR NUMBER { op.adressing_mode = IMMED; op.literal = $2; }
-  | DOLLAR STRING { op.adressing_mode = SYMBOL; op.symbol = $2; }
-  | NUMBER { op.adressing_mode = LIT_DIR; op.literal = $1; }
-  | STRING { op.adressing_mode = SYM_DIR; op.symbol = $1; }
-  | GPR { op.adressing_mode = REGDIR; op.reg = $1; }
-  | LBRACKETS GPR RBRACKETS { op.adressing_mode = REGIND; op.reg = $2; }
-  | LBRACKETS GPR PLUS NUMBER RBRACKETS { op.adressing_mode = REG_LIT; op.reg = $2; op.literal = $4; }
-  | LBRACKETS GPR PLUS STRING RBRACKETS { op.adressing_mode = REG_SYM; op.reg = $2; op.symbol = $4; }
+    DOLLAR NUMBER { state.op.adressing_mode = IMMED; state.op.literal = $2; }
+  | DOLLAR STRING { state.op.adressing_mode = SYMBOL; state.op.symbol = $2; }
+  | NUMBER { state.op.adressing_mode = LIT_DIR; state.op.literal = $1; }
+  | STRING { state.op.adressing_mode = SYM_DIR; state.op.symbol = $1; }
+  | GPR { state.op.adressing_mode = REGDIR; state.op.reg = $1; }
+  | LBRACKETS GPR RBRACKETS { state.op.adressing_mode = REGIND; state.op.reg = $2; }
+  | LBRACKETS GPR PLUS NUMBER RBRACKETS { state.op.adressing_mode = REG_LIT; state.op.reg = $2; state.op.literal = $4; }
+  | LBRACKETS GPR PLUS STRING RBRACKETS { state.op.adressing_mode = REG_SYM; state.op.reg = $2; state.op.symbol = $4; }
 
 OperandJump:
-    NUMBER { op.adressing_mode = LIT_DIR; op.literal = $1; }
-  | STRING { op.adressing_mode = SYM_DIR; op.symbol = $1; }
+    NUMBER { state.op.adressing_mode = LIT_DIR; state.op.literal = $1; }
+  | STRING { state.op.adressing_mode = SYM_DIR; state.op.symbol = $1; }
 %%
 
-void yyerror(const char *s) {
-  cout << "Parsing error at line: " << line_num << endl;
+void parse(string input_file_name, Assembler &assembler) {
+  Lexer lexer(input_file_name, assembler);
+  ParseState state;
+  yyparse(lexer, assembler, state);
+}
+
+// the parameters are bison's, the line comes from the lexer
+void yyerror(Lexer &lexer, Assembler &assembler, ParseState &, const char *) {
+  cout << "Parsing error at line: " << lexer.line << " of "
+       << assembler.source_file_name << endl;
   exit(-1);
-}
\ No newline at end of file
+}
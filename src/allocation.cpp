@@ -0,0 +1,41 @@
+#include <cstdlib>
+#include <new>
+
+#include "assembler.hpp"
+
+using namespace std;
+
+// Counted per thread, so that allocating threads share nothing. A thread's
+// counts are added to the totals when it exits.
+struct AllocationCounts {
+    unsigned long count = 0;
+    unsigned long bytes = 0;
+
+    ~AllocationCounts();
+};
+
+static atomic<unsigned long> exited_count(0);
+static atomic<unsigned long> exited_bytes(0);
+static thread_local AllocationCounts counts;
+
+AllocationCounts::~AllocationCounts() {
+    exited_count += count;
+    exited_bytes += bytes;
+    count = 0;
+    bytes = 0;
+}
+
+void *operator new(size_t size) {
+    counts.count++;
+    counts.bytes += size;
+    void *block = malloc(size ? size : 1);
+    if (!block) {
+        throw bad_alloc();
+    }
+    return block;
+}
+
+void allocation_totals(unsigned long &count, unsigned long &bytes) {
+    count = exited_count + counts.count;
+    bytes = exited_bytes + counts.bytes;
+}
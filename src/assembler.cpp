@@ -1,120 +1,595 @@
-#include <cstdio>
+#include <atomic>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <thread>
 
 #include "assembler.hpp"
-#include "parser.tab.hpp"
-
-extern int yyparse();
-extern FILE *yyin;
-ofstream output_file;
 
 using namespace std;
 
+// peephole rewrites of all files, by rule
+atomic<unsigned long> peephole_rewrites[PEEPHOLE_RULES];
+
+// assembles one source file, encoding its sections on up to threads threads
+void assemble_file(string input_file_name, string output_file_name,
+                   bool line_info, bool text_output, bool optimize,
+                   unsigned int threads) {
+    Assembler assembler;
+    assembler.source_file_name = input_file_name;
+    assembler.line_info = line_info;
+    assembler.text_output = text_output;
+    assembler.optimize = optimize;
+    assembler.threads = threads;
+    parse(input_file_name, assembler);
+
+    ofstream output_file(output_file_name, ios::binary);
+    if (!output_file) {
+        cout << "Failed to open file " << output_file_name << endl;
+        exit(-1);
+    }
+    assembler.assemble(output_file);
+    output_file.close();
+    for (int rule = 0; rule < PEEPHOLE_RULES; rule++) {
+        peephole_rewrites[rule] += assembler.rewrites[rule];
+    }
+}
+
+// Every input file may be preceded by -o and the name of its object file,
+// otherwise the object goes next to the source with a .o extension. With
+// -j N up to N files are assembled at a time.
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        cout << "Expected 3 arguments, got " << argc - 1 << "!" << endl;
+    bool line_info = false;
+    bool stats = false;
+    bool text_output = false;
+    bool optimize = false;
+    unsigned int jobs = 1;
+    vector<pair<string, string>> files;
+    string output_file_name;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-g") {
+            // adds a table mapping code back to source lines
+            line_info = true;
+        } else if (arg == "-text") {
+            // the old text objects, for reading them by eye
+            text_output = true;
+        } else if (arg == "-O") {
+            // the peephole pass
+            optimize = true;
+        } else if (arg == "-stats") {
+            stats = true;
+        } else if (arg == "-j" && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs == 0) {
+                cout << "Invalid job count " << argv[i] << "!" << endl;
+                return -1;
+            }
+        } else if (arg == "-o" && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else {
+            if (output_file_name.empty()) {
+                size_t dot = arg.rfind('.');
+                if (dot != string::npos && arg.find('/', dot) == string::npos) {
+                    output_file_name = arg.substr(0, dot) + ".o";
+                } else {
+                    output_file_name = arg + ".o";
+                }
+            }
+            files.push_back({arg, output_file_name});
+            output_file_name.clear();
+        }
+    }
+    if (files.empty()) {
+        cout << "No input files!" << endl;
         return -1;
     }
 
-    output_file = ofstream(argv[2]);
+    // the hardware threads are split between the files assembled at a time
+    jobs = min(jobs, (unsigned int)files.size());
+    unsigned int threads = max(1U, thread::hardware_concurrency() / jobs);
+    atomic<unsigned int> next(0);
+    auto assemble_files = [&]() {
+        for (unsigned int i = next++; i < files.size(); i = next++) {
+            assemble_file(files[i].first, files[i].second, line_info,
+                          text_output, optimize, threads);
+        }
+    };
 
-    FILE *input_file = fopen(argv[3], "r");
-    if (!input_file) {
-        cout << "Failed to open file " << argv[3] << endl;
-        return -1;
+    vector<thread> workers;
+    for (unsigned int i = 1; i < jobs; i++) {
+        workers.emplace_back(assemble_files);
+    }
+    assemble_files();
+    for (thread &worker : workers) {
+        worker.join();
     }
 
-    yyin = input_file;
-    yyparse();
-    fclose(input_file);
+    if (stats) {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        unsigned long allocations, allocated_bytes;
+        allocation_totals(allocations, allocated_bytes);
+        cout << "Allocations: " << allocations << ", " << allocated_bytes
+             << " bytes" << endl;
+        cout << "Peak memory: " << usage.ru_maxrss << " KB" << endl;
+        for (int rule = 0; optimize && rule < PEEPHOLE_RULES; rule++) {
+            cout << "Peephole " << PEEPHOLE_RULE_NAMES[rule] << ": "
+                 << peephole_rewrites[rule] << endl;
+        }
+    }
+    return 0;
+}
 
-    input_file = fopen(argv[3], "r");
-    if (!input_file) {
-        cout << "Failed to open file " << argv[3] << endl;
-        return -1;
+// The first pass lays out sections, symbols and pools, and stops at .end.
+// The second pass encodes each section on its own, in parallel, and the
+// results are written out in source order.
+void Assembler::assemble(ostream &output) {
+    // The first pass runs again while relaxation or pool placement changes
+    // the layout. The second run also sees the labels defined after their
+    // use.
+    if (optimize) {
+        peephole();
+    }
+    size_t end = 0;
+    vector<size_t> starts;
+    for (pass = 0; pass < 2 || changes; pass++) {
+        changes = 0;
+        second_pass = false;
+        starts.clear();
+        for (end = 0; end < program.size(); end++) {
+            if (program[end].kind == SECTION_DIRECTIVE) {
+                starts.push_back(end);
+            }
+            place_pool(end);
+            execute(program[end]);
+            if (second_pass) {
+                break;
+            }
+        }
+        if (!second_pass) {
+            return;
+        }
     }
-    yyin = input_file;
-    yyparse();
 
-    fclose(input_file);
-    output_file.close();
-    return 0;
+    // directives before the first section
+    for (size_t i = 0; i < (starts.empty() ? end : starts[0]); i++) {
+        execute(program[i]);
+    }
+    starts.push_back(end);
+
+    ObjectTables tables;
+    if (!text_output) {
+        make_object_tables(tables);
+    }
+
+    unsigned int count = starts.size() - 1;
+    vector<string> outputs(count);
+    vector<vector<LineEntry>> line_tables(count);
+    atomic<unsigned int> next(0);
+    auto encode = [&]() {
+        for (unsigned int i = next++; i < count; i = next++) {
+            Assembler encoder(*this);
+            for (size_t s = starts[i]; s < starts[i + 1]; s++) {
+                encoder.execute(program[s]);
+            }
+            encoder.finish_section();
+
+            if (text_output) {
+                stringstream text;
+                print_section(encoder.encoded, names, text);
+                outputs[i] = text.str();
+            } else {
+                write_section(encoder.encoded, tables, outputs[i]);
+            }
+            line_tables[i] = move(encoder.line_table);
+        }
+    };
+
+    unsigned int thread_count = min(
+        count, threads ? threads : max(1U, thread::hardware_concurrency()));
+    vector<thread> threads;
+    for (unsigned int i = 1; i < thread_count; i++) {
+        threads.emplace_back(encode);
+    }
+    encode();
+    for (thread &worker : threads) {
+        worker.join();
+    }
+
+    if (line_info) {
+        for (vector<LineEntry> &lines : line_tables) {
+            line_table.insert(line_table.end(), lines.begin(), lines.end());
+        }
+    }
+    if (!text_output) {
+        write_object(outputs, tables, line_table, output);
+        return;
+    }
+
+    for (string &text : outputs) {
+        output << text;
+    }
+    print_symbol_table(symbol_table, names, output);
+    if (line_info) {
+        print_line_table(source_file_name, line_table, names, output);
+    }
 }
 
-void Assembler::label(string name) {
-    if (second_pass)
+// The object keeps the global symbols, which the linker resolves, and the
+// undefined symbols and sections that relocations are made against.
+void Assembler::make_object_tables(ObjectTables &tables) {
+    vector<bool> is_section(symbol_table.size());
+    for (auto &it : sections) {
+        is_section[it.first] = true;
+    }
+
+    tables.index.assign(symbol_table.size(), OBJECT_NONE);
+    for (unsigned int id = 0; id < symbol_table.size(); id++) {
+        Symbol &sym = symbol_table[id];
+        if (!sym.is_global && sym.is_defined && !is_section[id]) {
+            continue;
+        }
+        ObjectSymbol symbol;
+        symbol.name = tables.add_string(names.name(id));
+        symbol.value = sym.value;
+        symbol.section = OBJECT_NONE;
+        symbol.flags = (sym.is_global ? OBJECT_GLOBAL : 0) |
+                       (sym.is_defined ? OBJECT_DEFINED : 0);
+        tables.index[id] = tables.symbols.size();
+        tables.symbols.push_back(symbol);
+    }
+    // a section may be numbered after the symbols defined in it
+    for (unsigned int id = 0; id < symbol_table.size(); id++) {
+        unsigned int section = symbol_table[id].section;
+        if (tables.index[id] != OBJECT_NONE && section != NO_SECTION) {
+            tables.symbols[tables.index[id]].section = tables.name(section);
+        }
+    }
+
+    if (line_info) {
+        tables.source_file = tables.add_string(source_file_name);
+    }
+}
+
+Assembler::Assembler(Assembler &first_pass)
+    : names(first_pass.names), symbol_table(first_pass.symbol_table),
+      sections(first_pass.sections) {
+    second_pass = true;
+    line_info = first_pass.line_info;
+}
+
+unsigned int Interner::intern(string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+
+    if (block_used + name.size() > block_size) {
+        block_size = max((size_t)1 << 16, name.size());
+        blocks.emplace_back(new char[block_size]);
+        block_used = 0;
+    }
+    char *copy = blocks.back().get() + block_used;
+    name.copy(copy, name.size());
+    block_used += name.size();
+
+    unsigned int id = names.size();
+    names.push_back(string_view(copy, name.size()));
+    ids[names.back()] = id;
+    return id;
+}
+
+unsigned int Assembler::intern(string_view name) {
+    unsigned int id = names.intern(name);
+    if (id >= symbol_table.size()) {
+        symbol_table.resize(id + 1);
+    }
+    return id;
+}
+
+void Assembler::finish_section() {
+    put_pool(false);
+    current_section->content.resize(current_section->length);
+}
+
+void Assembler::execute(Statement &statement) {
+    const Instruction &instruction = statement.instruction;
+    if (statement.pool != NO_POOL) {
+        put_pool(statement.pool == BRANCHED_POOL);
+    }
+
+    switch (statement.kind) {
+    case LABEL_STATEMENT:
+        label(statement.number);
+        break;
+    case LINE_END:
+        line_end(statement.number, statement.is_code);
+        break;
+    case GLOBAL_DIRECTIVE:
+        global(statement.symbols);
+        break;
+    case EXTERN_DIRECTIVE:
+        // symbols used but not defined here are external anyway
+        break;
+    case SECTION_DIRECTIVE:
+        section(statement.number);
+        break;
+    case WORD_SYMBOL_DIRECTIVE:
+        word((unsigned int)statement.number);
+        break;
+    case WORD_LITERAL_DIRECTIVE:
+        word(statement.number);
+        break;
+    case SKIP_DIRECTIVE:
+        skip(statement.number);
+        break;
+    case VECTORS_DIRECTIVE:
+        vectors(statement.symbols);
+        break;
+    case LTORG_DIRECTIVE:
+        ltorg();
+        break;
+    case END_DIRECTIVE:
+        end();
+        break;
+    case HALT_INSTRUCTION:
+        halt_instruction();
+        break;
+    case INT_INSTRUCTION:
+        int_instruction();
+        break;
+    case IRET_INSTRUCTION:
+        iret_instruction();
+        break;
+    case RET_INSTRUCTION:
+        ret_instruction();
+        break;
+    case CALL_INSTRUCTION:
+        relax(statement.instruction);
+        call_instruction(instruction);
+        break;
+    case JMP_INSTRUCTION:
+        relax(statement.instruction);
+        jmp_instruction(instruction);
+        break;
+    case BEQ_INSTRUCTION:
+        relax(statement.instruction);
+        beq_instruction(instruction);
+        break;
+    case BNE_INSTRUCTION:
+        relax(statement.instruction);
+        bne_instruction(instruction);
+        break;
+    case BGT_INSTRUCTION:
+        relax(statement.instruction);
+        bgt_instruction(instruction);
+        break;
+    case PUSH_INSTRUCTION:
+        push_instruction(instruction.gpr1);
+        break;
+    case POP_INSTRUCTION:
+        pop_instruction(instruction.gpr1);
+        break;
+    case XCHG_INSTRUCTION:
+        xchg_instruction(instruction);
+        break;
+    case ADD_INSTRUCTION:
+        add_instruction(instruction);
+        break;
+    case SUB_INSTRUCTION:
+        sub_instruction(instruction);
+        break;
+    case MUL_INSTRUCTION:
+        mul_instruction(instruction);
+        break;
+    case DIV_INSTRUCTION:
+        div_instruction(instruction);
+        break;
+    case NOT_INSTRUCTION:
+        not_instruction(instruction);
+        break;
+    case AND_INSTRUCTION:
+        and_instruction(instruction);
+        break;
+    case OR_INSTRUCTION:
+        or_instruction(instruction);
+        break;
+    case XOR_INSTRUCTION:
+        xor_instruction(instruction);
+        break;
+    case SHL_INSTRUCTION:
+        shl_instruction(instruction);
+        break;
+    case SHR_INSTRUCTION:
+        shr_instruction(instruction);
+        break;
+    case LD_INSTRUCTION:
+        relax(statement.instruction);
+        ld_instruction(instruction);
+        break;
+    case ST_INSTRUCTION:
+        relax(statement.instruction);
+        st_instruction(instruction);
+        break;
+    case CSRRD_INSTRUCTION:
+        csrrd_instruction(instruction);
+        break;
+    case CSRWR_INSTRUCTION:
+        csrwr_instruction(instruction);
+        break;
+    }
+
+    if (statement.kind >= HALT_INSTRUCTION) {
+        after_code = true;
+        after_jump = statement.kind == HALT_INSTRUCTION ||
+                     statement.kind == IRET_INSTRUCTION ||
+                     statement.kind == RET_INSTRUCTION ||
+                     statement.kind == JMP_INSTRUCTION;
+    } else if (statement.kind != LABEL_STATEMENT &&
+               statement.kind != LINE_END) {
+        after_code = false;
+        after_jump = false;
+    }
+}
+
+// The open pool goes down before a statement that could take its first use
+// out of reach, and between code and the data after it. Past half the reach
+// it also goes after an unconditional jump, where it needs no jump around.
+// Labels go with the statement after them, so that none ends up on a pool.
+void Assembler::place_pool(size_t index) {
+    Statement &statement = program[index];
+    StatementKind kind = statement.kind;
+    bool emits = kind == LABEL_STATEMENT || kind >= HALT_INSTRUCTION ||
+                 (kind >= WORD_SYMBOL_DIRECTIVE && kind <= VECTORS_DIRECTIVE);
+    if (!current_section || !emits) {
         return;
+    }
+    size_t next = index;
+    while (next + 1 < program.size() &&
+           (program[next].kind == LABEL_STATEMENT ||
+            program[next].kind == LINE_END)) {
+        next++;
+    }
 
-    if (symbol_table.find(name) == symbol_table.end()) {
-        symbol_table[name] =
-            *new Symbol(lc, false, true, current_section->name);
+    int size = 0;
+    bool is_data = false;
+    switch (program[next].kind) {
+    case WORD_SYMBOL_DIRECTIVE:
+    case WORD_LITERAL_DIRECTIVE:
+        size = 4;
+        is_data = true;
+        break;
+    case SKIP_DIRECTIVE:
+        size = program[next].number;
+        is_data = true;
+        break;
+    case VECTORS_DIRECTIVE:
+        size = 4 * VECTOR_COUNT;
+        is_data = true;
+        break;
+    default:
+        // at most two instructions
+        if (program[next].kind >= HALT_INSTRUCTION) {
+            size = 8;
+        }
+        break;
+    }
 
-    } else {
-        if (symbol_table[name].is_defined) {
-            cout << "Symbol " << name << " defined twice!" << endl;
-            exit(-1);
+    PoolPlacement placement = NO_POOL;
+    Pool &pool = current_section->pools[pool_index];
+    if (!pool.empty()) {
+        int distance = lc - pool.first_use;
+        if ((is_data && after_code) ||
+            distance + size + pool.size() > MAX_DISPLACEMENT) {
+            placement = after_jump ? INLINE_POOL : BRANCHED_POOL;
+        } else if (after_jump && distance > MAX_DISPLACEMENT / 2) {
+            placement = INLINE_POOL;
         }
-        symbol_table[name].is_defined = true;
-        symbol_table[name].section_name = current_section->name;
-        symbol_table[name].value = lc;
+    }
+    if (statement.pool != placement) {
+        statement.pool = placement;
+        changes++;
     }
 }
 
-void Assembler::global(vector<string> symbols) {
-    if (second_pass) {
-        for (string name : symbols) {
-            if (!symbol_table[name].is_defined) {
-                cout << "Symbol " << name << " not defined!" << endl;
-                exit(-1);
-            }
+// Puts down the open pool here, behind a jump over it if asked to.
+void Assembler::put_pool(bool branch) {
+    Pool &pool = current_section->pools[pool_index];
+    if (pool.empty()) {
+        return;
+    }
+
+    int size = pool.size();
+    if (branch) {
+        if (second_pass) {
+            unsigned char second_byte = (pc << 4) & 0xF0;
+            unsigned char third_byte = (size >> 8) & 0x0F;
+            unsigned char forth_byte = size & 0xFF;
+            current_section->add_bytes(
+                {0x30, second_byte, third_byte, forth_byte});
         }
+        lc += 4;
+    }
 
+    if (second_pass) {
+        current_section->content.resize(lc + size);
+        for (auto &it : pool.literals) {
+            current_section->write_int(it.first, it.second);
+        }
+        for (auto &it : pool.symbols) {
+            make_relocation(it.first, it.second);
+        }
+        lc += size;
     } else {
-        for (string name : symbols) {
-            if (symbol_table.find(name) == symbol_table.end()) {
-                symbol_table[name] = *new Symbol(true, false);
-            } else {
-                symbol_table[name].is_global = true;
-            }
+        for (auto &it : pool.literals) {
+            it.second = lc;
+            lc += 4;
+        }
+        for (auto &it : pool.symbols) {
+            it.second = lc;
+            lc += 4;
         }
+        current_section->relocation_count += pool.symbols.size();
+        current_section->pools.emplace_back();
     }
+    pool_index++;
+    line_start = lc;
 }
+void Assembler::label(unsigned int name) {
+    if (second_pass)
+        return;
 
-void Assembler::extern_directive(vector<string> symbols) {}
+    Symbol &symbol = symbol_table[name];
+    if (symbol.is_defined && pass == 0) {
+        cout << "Symbol " << names.name(name) << " defined twice!" << endl;
+        exit(-1);
+    }
+    symbol.is_defined = true;
+    symbol.section = current_section->name;
+    symbol.value = lc;
+}
 
-void Assembler::section(string name) {
-    if (second_pass) {
-        if (current_section) {
-            current_section->content.resize(current_section->length);
-            current_section->write_literals();
-            make_relocations();
-            print_section(*current_section);
+void Assembler::global(const vector<unsigned int> &symbols) {
+    for (unsigned int name : symbols) {
+        if (!second_pass) {
+            symbol_table[name].is_global = true;
+        } else if (!symbol_table[name].is_defined) {
+            cout << "Symbol " << names.name(name) << " not defined!" << endl;
+            exit(-1);
         }
-        current_section = &sections[name];
+    }
+}
+
+void Assembler::section(unsigned int name) {
+    if (second_pass) {
+        encoded = sections.at(name);
+        encoded.relocations.reserve(encoded.relocation_count);
+        current_section = &encoded;
 
     } else {
         if (current_section) {
+            put_pool(false);
             current_section->length = lc;
-            current_section->allocate_literals();
-            current_section->alocate_symbols();
-            sections[current_section->name] = *current_section;
         }
-        current_section = new Section(name);
+        current_section = &(sections[name] = Section(name));
     }
     lc = 0;
+    pool_index = 0;
+    after_code = false;
+    after_jump = false;
 }
 
-void Assembler::word(string symbol) {
+void Assembler::word(unsigned int symbol) {
     if (second_pass) {
         make_relocation(symbol, lc);
         current_section->write_int(0);
-
     } else {
-        if (symbol_table.find(symbol) == symbol_table.end()) {
-            symbol_table[symbol] = *new Symbol(false, false);
-        }
+        current_section->relocation_count++;
     }
     lc += 4;
 }
@@ -133,51 +608,143 @@ void Assembler::skip(int bytes_to_skip) {
     lc += bytes_to_skip;
 }
 
+// One word per interrupt cause. Cause 0 never reaches the guest, so its
+// handler also fills the slots of causes missing from the list.
+void Assembler::vectors(const vector<unsigned int> &handlers) {
+    if (handlers.size() > VECTOR_COUNT) {
+        cout << "At most " << VECTOR_COUNT << " interrupt vectors allowed!"
+             << endl;
+        exit(-1);
+    }
+    if (lc % 4) {
+        cout << "Vector table must be word aligned!" << endl;
+        exit(-1);
+    }
+    for (unsigned int cause = 0; cause < VECTOR_COUNT; cause++) {
+        word(cause < handlers.size() ? handlers[cause] : handlers[0]);
+    }
+}
+
+// the pool goes right here, control must not fall through into it
+void Assembler::ltorg() {
+    if (current_section) {
+        put_pool(false);
+    }
+}
+
 void Assembler::end() {
-    if (second_pass) {
-        if (current_section) {
-            current_section->content.resize(current_section->length);
-            current_section->write_literals();
-            make_relocations();
-            print_section(*current_section);
-        }
-        print_symbol_table(symbol_table);
+    if (current_section) {
+        put_pool(false);
+        current_section->length = lc;
+    }
+    second_pass = true;
+    current_section = nullptr;
+    lc = 0;
+}
 
-    } else {
-        second_pass = true;
-        if (current_section) {
-            current_section->length = lc;
-            current_section->allocate_literals();
-            current_section->alocate_symbols();
-            sections[current_section->name] = *current_section;
-        }
-        current_section = nullptr;
-        lc = 0;
+// attributes the code emitted since the previous source line to this one
+void Assembler::line_end(int line, bool is_code) {
+    if (second_pass && line_info && is_code && current_section &&
+        lc > line_start) {
+        line_table.push_back(
+            {current_section->name, line_start, lc - line_start, line});
     }
+    line_start = lc;
 }
 
-void Assembler::make_relocation(string name, int location) {
-    Symbol sym = symbol_table[name];
-    Relocation *rel;
+void Assembler::make_relocation(unsigned int name, int location) {
+    Symbol &sym = symbol_table[name];
     if (sym.is_global || !sym.is_defined) {
-        rel = new Relocation(location, 0, name);
+        current_section->relocations.emplace_back(location, 0, name);
     } else {
-        rel = new Relocation(location, sym.value, sym.section_name);
+        current_section->relocations.emplace_back(location, sym.value,
+                                                  sym.section);
     }
-    current_section->relocations.push_back(*rel);
 }
 
-void Assembler::make_relocations() {
-    for (auto it : current_section->symbol_pool) {
-        make_relocation(it.first, it.second);
+// A symbol operand defined earlier in this section, or later in it as of
+// the previous pass, is reached relative to pc when the displacement fits.
+// Forward distances are only exact once a pass changes nothing, so a form
+// is checked again in every pass. One that fell out of reach as pools moved
+// in between stays in the pool from then on.
+void Assembler::relax(Instruction &instruction) {
+    const Operand &op = instruction.operand;
+    if (second_pass || instruction.far ||
+        (op.adressing_mode != SYMBOL && op.adressing_mode != SYM_DIR)) {
+        return;
+    }
+    Symbol &sym = symbol_table[op.symbol];
+    bool in_reach = sym.is_defined && sym.section == current_section->name &&
+                    fits_12_bits(sym.value - (int)lc - 4);
+    if (in_reach != instruction.pc_relative) {
+        instruction.pc_relative = in_reach;
+        instruction.far = !in_reach;
+        changes++;
+    }
+}
+
+// The first pass takes a pool slot for each value loaded, unless the
+// previous pool has one in reach.
+void Assembler::literal_used(int literal) {
+    vector<Pool> &pools = current_section->pools;
+    if (pool_index > 0) {
+        int slot = pools[pool_index - 1].literal_slot(literal);
+        if (slot >= 0 && fits_12_bits(slot - (int)lc - 4)) {
+            return;
+        }
+    }
+    Pool &pool = pools[pool_index];
+    if (pool.empty()) {
+        pool.first_use = lc;
+    }
+    pool.add_literal(literal);
+}
+
+void Assembler::symbol_used(const Instruction &instruction) {
+    if (instruction.pc_relative) {
+        return;
     }
+    unsigned int symbol = instruction.operand.symbol;
+    vector<Pool> &pools = current_section->pools;
+    if (pool_index > 0) {
+        int slot = pools[pool_index - 1].symbol_slot(symbol);
+        if (slot >= 0 && fits_12_bits(slot - (int)lc - 4)) {
+            return;
+        }
+    }
+    Pool &pool = pools[pool_index];
+    if (pool.empty()) {
+        pool.first_use = lc;
+    }
+    pool.add_symbol(symbol);
 }
 
-void Assembler::symbol_used(string symbol) {
-    if (symbol_table.find(symbol) == symbol_table.end()) {
-        symbol_table[symbol] = *new Symbol(false, false);
+// from the next instruction to the slot the first pass took for a value
+int Assembler::literal_offset(int literal) {
+    vector<Pool> &pools = current_section->pools;
+    if (pool_index > 0) {
+        int slot = pools[pool_index - 1].literal_slot(literal);
+        if (slot >= 0 && fits_12_bits(slot - (int)lc - 4)) {
+            return slot - lc - 4;
+        }
     }
-    current_section->register_symbol(symbol);
+    return pools[pool_index].literal_slot(literal) - lc - 4;
+}
+
+// from the next instruction to the symbol, or to its pool slot
+int Assembler::symbol_offset(const Instruction &instruction) {
+    unsigned int symbol = instruction.operand.symbol;
+    if (instruction.pc_relative) {
+        return symbol_table[symbol].value - lc - 4;
+    }
+    vector<Pool> &pools = current_section->pools;
+    if (pool_index > 0) {
+        int slot = pools[pool_index - 1].symbol_slot(symbol);
+        if (slot >= 0 && fits_12_bits(slot - (int)lc - 4)) {
+            return slot - lc - 4;
+        }
+    }
+    return pools[pool_index].symbol_slot(symbol) - lc - 4;
 }
 
 void Assembler::halt_instruction() {
@@ -208,8 +775,8 @@ void Assembler::iret_instruction() {
 
 void Assembler::ret_instruction() { pop_instruction(15); }
 
-void Assembler::call_instruction(Instruction instruction) {
-    Operand op = instruction.operand;
+void Assembler::call_instruction(const Instruction &instruction) {
+    const Operand &op = instruction.operand;
     unsigned char second_byte;
     unsigned char third_byte;
     unsigned char forth_byte;
@@ -224,8 +791,7 @@ void Assembler::call_instruction(Instruction instruction) {
                     {0x20, 0x00, third_byte, forth_byte});
 
             } else {
-                int offset_to_literal =
-                    current_section->literal_pool[op.literal] - lc - 4;
+                int offset_to_literal = literal_offset(op.literal);
                 second_byte = (pc << 4) & 0xF0;
                 third_byte = (offset_to_literal >> 8) & 0x0F;
                 forth_byte = offset_to_literal & 0xFF;
@@ -235,13 +801,13 @@ void Assembler::call_instruction(Instruction instruction) {
             lc += 4;
             break;
         case SYM_DIR:
-            int offset_to_symbol =
-                current_section->symbol_pool[op.symbol] - lc - 4;
+            int offset_to_symbol = symbol_offset(instruction);
+            unsigned char operation = instruction.pc_relative ? 0x20 : 0x21;
             second_byte = (pc << 4) & 0xF0;
             third_byte = (offset_to_symbol >> 8) & 0x0F;
             forth_byte = offset_to_symbol & 0xFF;
             current_section->add_bytes(
-                {0x21, second_byte, third_byte, forth_byte});
+                {operation, second_byte, third_byte, forth_byte});
             lc += 4;
             break;
         }
@@ -249,20 +815,20 @@ void Assembler::call_instruction(Instruction instruction) {
         switch (op.adressing_mode) {
         case LIT_DIR:
             if (!fits_12_bits(op.literal)) {
-                current_section->register_literal(op.literal);
+                literal_used(op.literal);
             }
             lc += 4;
             break;
         case SYM_DIR:
-            symbol_used(op.symbol);
+            symbol_used(instruction);
             lc += 4;
             break;
         }
     }
 }
 
-void Assembler::jmp_instruction(Instruction instruction) {
-    Operand op = instruction.operand;
+void Assembler::jmp_instruction(const Instruction &instruction) {
+    const Operand &op = instruction.operand;
     unsigned char second_byte;
     unsigned char third_byte;
     unsigned char forth_byte;
@@ -277,8 +843,7 @@ void Assembler::jmp_instruction(Instruction instruction) {
                     {0x30, 0x00, third_byte, forth_byte});
 
             } else {
-                int offset_to_literal =
-                    current_section->literal_pool[op.literal] - lc - 4;
+                int offset_to_literal = literal_offset(op.literal);
                 second_byte = (pc << 4) & 0xF0;
                 third_byte = (offset_to_literal >> 8) & 0x0F;
                 forth_byte = offset_to_literal & 0xFF;
@@ -288,13 +853,13 @@ void Assembler::jmp_instruction(Instruction instruction) {
             lc += 4;
             break;
         case SYM_DIR:
-            int offset_to_symbol =
-                current_section->symbol_pool[op.symbol] - lc - 4;
+            int offset_to_symbol = symbol_offset(instruction);
+            unsigned char operation = instruction.pc_relative ? 0x30 : 0x38;
             second_byte = (pc << 4) & 0xF0;
             third_byte = (offset_to_symbol >> 8) & 0x0F;
             forth_byte = offset_to_symbol & 0xFF;
             current_section->add_bytes(
-                {0x38, second_byte, third_byte, forth_byte});
+                {operation, second_byte, third_byte, forth_byte});
             lc += 4;
             break;
         }
@@ -302,20 +867,20 @@ void Assembler::jmp_instruction(Instruction instruction) {
         switch (op.adressing_mode) {
         case LIT_DIR:
             if (!fits_12_bits(op.literal)) {
-                current_section->register_literal(op.literal);
+                literal_used(op.literal);
             }
             lc += 4;
             break;
         case SYM_DIR:
-            symbol_used(op.symbol);
+            symbol_used(instruction);
             lc += 4;
             break;
         }
     }
 }
 
-void Assembler::beq_instruction(Instruction instruction) {
-    Operand op = instruction.operand;
+void Assembler::beq_instruction(const Instruction &instruction) {
+    const Operand &op = instruction.operand;
     unsigned char second_byte;
     unsigned char third_byte;
     unsigned char forth_byte;
@@ -329,11 +894,10 @@ void Assembler::beq_instruction(Instruction instruction) {
                     ((instruction.gpr2 << 4) & 0xF0) | (op.literal >> 8) & 0x0F;
                 forth_byte = op.literal & 0xFF;
                 current_section->add_bytes(
-                    {0x31, 0x00, third_byte, forth_byte});
+                    {0x31, second_byte, third_byte, forth_byte});
 
             } else {
-                int offset_to_literal =
-                    current_section->literal_pool[op.literal] - lc - 4;
+                int offset_to_literal = literal_offset(op.literal);
                 second_byte = ((pc << 4) & 0xF0) | ((instruction.gpr1) & 0x0F);
                 third_byte = ((instruction.gpr2 << 4) & 0xF0) |
                              (offset_to_literal >> 8) & 0x0F;
@@ -344,14 +908,14 @@ void Assembler::beq_instruction(Instruction instruction) {
             lc += 4;
             break;
         case SYM_DIR:
-            int offset_to_symbol =
-                current_section->symbol_pool[op.symbol] - lc - 4;
+            int offset_to_symbol = symbol_offset(instruction);
+            unsigned char operation = instruction.pc_relative ? 0x31 : 0x39;
             second_byte = ((pc << 4) & 0xF0) | ((instruction.gpr1) & 0x0F);
             third_byte = ((instruction.gpr2 << 4) & 0xF0) |
                          (offset_to_symbol >> 8) & 0x0F;
             forth_byte = offset_to_symbol & 0xFF;
             current_section->add_bytes(
-                {0x39, second_byte, third_byte, forth_byte});
+                {operation, second_byte, third_byte, forth_byte});
             lc += 4;
             break;
         }
@@ -359,20 +923,20 @@ void Assembler::beq_instruction(Instruction instruction) {
         switch (op.adressing_mode) {
         case LIT_DIR:
             if (!fits_12_bits(op.literal)) {
-                current_section->register_literal(op.literal);
+                literal_used(op.literal);
             }
             lc += 4;
             break;
         case SYM_DIR:
-            symbol_used(op.symbol);
+            symbol_used(instruction);
             lc += 4;
             break;
         }
     }
 }
 
-void Assembler::bne_instruction(Instruction instruction) {
-    Operand op = instruction.operand;
+void Assembler::bne_instruction(const Instruction &instruction) {
+    const Operand &op = instruction.operand;
     unsigned char second_byte;
     unsigned char third_byte;
     unsigned char forth_byte;
@@ -386,11 +950,10 @@ void Assembler::bne_instruction(Instruction instruction) {
                     ((instruction.gpr2 << 4) & 0xF0) | (op.literal >> 8) & 0x0F;
                 forth_byte = op.literal & 0xFF;
                 current_section->add_bytes(
-                    {0x32, 0x00, third_byte, forth_byte});
+                    {0x32, second_byte, third_byte, forth_byte});
 
             } else {
-                int offset_to_literal =
-                    current_section->literal_pool[op.literal] - lc - 4;
+                int offset_to_literal = literal_offset(op.literal);
                 second_byte = ((pc << 4) & 0xF0) | ((instruction.gpr1) & 0x0F);
                 third_byte = ((instruction.gpr2 << 4) & 0xF0) |
                              (offset_to_literal >> 8) & 0x0F;
@@ -401,14 +964,14 @@ void Assembler::bne_instruction(Instruction instruction) {
             lc += 4;
             break;
         case SYM_DIR:
-            int offset_to_symbol =
-                current_section->symbol_pool[op.symbol] - lc - 4;
+            int offset_to_symbol = symbol_offset(instruction);
+            unsigned char operation = instruction.pc_relative ? 0x32 : 0x3A;
             second_byte = ((pc << 4) & 0xF0) | ((instruction.gpr1) & 0x0F);
             third_byte = ((instruction.gpr2 << 4) & 0xF0) |
                          (offset_to_symbol >> 8) & 0x0F;
             forth_byte = offset_to_symbol & 0xFF;
             current_section->add_bytes(
-                {0x3A, second_byte, third_byte, forth_byte});
+                {operation, second_byte, third_byte, forth_byte});
             lc += 4;
             break;
         }
@@ -416,20 +979,20 @@ void Assembler::bne_instruction(Instruction instruction) {
         switch (op.adressing_mode) {
         case LIT_DIR:
             if (!fits_12_bits(op.literal)) {
-                current_section->register_literal(op.literal);
+                literal_used(op.literal);
             }
             lc += 4;
             break;
         case SYM_DIR:
-            symbol_used(op.symbol);
+            symbol_used(instruction);
             lc += 4;
             break;
         }
     }
 }
 
-void Assembler::bgt_instruction(Instruction instruction) {
-    Operand op = instruction.operand;
+void Assembler::bgt_instruction(const Instruction &instruction) {
+    const Operand &op = instruction.operand;
     unsigned char second_byte;
     unsigned char third_byte;
     unsigned char forth_byte;
@@ -444,11 +1007,10 @@ void Assembler::bgt_instruction(Instruction instruction) {
                 forth_byte = op.literal & 0xFF;
                 forth_byte = op.literal & 0xFF;
                 current_section->add_bytes(
-                    {0x33, 0x00, third_byte, forth_byte});
+                    {0x33, second_byte, third_byte, forth_byte});
 
             } else {
-                int offset_to_literal =
-                    current_section->literal_pool[op.literal] - lc - 4;
+                int offset_to_literal = literal_offset(op.literal);
                 second_byte = ((pc << 4) & 0xF0) | ((instruction.gpr1) & 0x0F);
                 third_byte = ((instruction.gpr2 << 4) & 0xF0) |
                              (offset_to_literal >> 8) & 0x0F;
@@ -459,14 +1021,14 @@ void Assembler::bgt_instruction(Instruction instruction) {
             lc += 4;
             break;
         case SYM_DIR:
-            int offset_to_symbol =
-                current_section->symbol_pool[op.symbol] - lc - 4;
+            int offset_to_symbol = symbol_offset(instruction);
+            unsigned char operation = instruction.pc_relative ? 0x33 : 0x3B;
             second_byte = ((pc << 4) & 0xF0) | ((instruction.gpr1) & 0x0F);
             third_byte = ((instruction.gpr2 << 4) & 0xF0) |
                          (offset_to_symbol >> 8) & 0x0F;
             forth_byte = offset_to_symbol & 0xFF;
             current_section->add_bytes(
-                {0x3B, second_byte, third_byte, forth_byte});
+                {operation, second_byte, third_byte, forth_byte});
             lc += 4;
             break;
         }
@@ -474,12 +1036,12 @@ void Assembler::bgt_instruction(Instruction instruction) {
         switch (op.adressing_mode) {
         case LIT_DIR:
             if (!fits_12_bits(op.literal)) {
-                current_section->register_literal(op.literal);
+                literal_used(op.literal);
             }
             lc += 4;
             break;
         case SYM_DIR:
-            symbol_used(op.symbol);
+            symbol_used(instruction);
             lc += 4;
             break;
         }
@@ -503,7 +1065,7 @@ void Assembler::pop_instruction(int reg) {
     lc += 4;
 }
 
-void Assembler::xchg_instruction(Instruction instruction) {
+void Assembler::xchg_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -515,7 +1077,7 @@ void Assembler::xchg_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::add_instruction(Instruction instruction) {
+void Assembler::add_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -528,7 +1090,7 @@ void Assembler::add_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::sub_instruction(Instruction instruction) {
+void Assembler::sub_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -541,7 +1103,7 @@ void Assembler::sub_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::mul_instruction(Instruction instruction) {
+void Assembler::mul_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -554,7 +1116,7 @@ void Assembler::mul_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::div_instruction(Instruction instruction) {
+void Assembler::div_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -567,7 +1129,7 @@ void Assembler::div_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::not_instruction(Instruction instruction) {
+void Assembler::not_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char reg = instruction.gpr1;
         unsigned char second_byte = ((reg << 4) & 0xF0) | (reg & 0x0F);
@@ -576,7 +1138,7 @@ void Assembler::not_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::and_instruction(Instruction instruction) {
+void Assembler::and_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -589,7 +1151,7 @@ void Assembler::and_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::or_instruction(Instruction instruction) {
+void Assembler::or_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -602,7 +1164,7 @@ void Assembler::or_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::xor_instruction(Instruction instruction) {
+void Assembler::xor_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -615,7 +1177,7 @@ void Assembler::xor_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::shl_instruction(Instruction instruction) {
+void Assembler::shl_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -628,7 +1190,7 @@ void Assembler::shl_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::shr_instruction(Instruction instruction) {
+void Assembler::shr_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char destination = instruction.gpr2;
@@ -641,9 +1203,9 @@ void Assembler::shr_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::ld_instruction(Instruction instruction) {
+void Assembler::ld_instruction(const Instruction &instruction) {
     if (second_pass) {
-        Operand op = instruction.operand;
+        const Operand &op = instruction.operand;
         unsigned char destination = instruction.gpr1;
         unsigned char second_byte;
         unsigned char third_byte;
@@ -662,8 +1224,7 @@ void Assembler::ld_instruction(Instruction instruction) {
                     {0x91, second_byte, third_byte, forth_byte});
 
             } else {
-                int offset_to_literal =
-                    current_section->literal_pool[op.literal] - lc - 4;
+                int offset_to_literal = literal_offset(op.literal);
                 second_byte = ((destination << 4) & 0xF0) | (pc & 0x0F);
                 third_byte = (offset_to_literal >> 8) & 0x0F;
                 forth_byte = offset_to_literal & 0xFF;
@@ -673,12 +1234,14 @@ void Assembler::ld_instruction(Instruction instruction) {
             lc += 4;
             break;
         case SYMBOL:
-            offset_to_symbol = current_section->symbol_pool[op.symbol] - lc - 4;
+            // reg[A] = pc + offset, or the symbol's pool slot
+            offset_to_symbol = symbol_offset(instruction);
             second_byte = ((destination << 4) & 0xF0) | (pc & 0x0F);
             third_byte = (offset_to_symbol >> 8) & 0x0F;
             forth_byte = offset_to_symbol & 0xFF;
             current_section->add_bytes(
-                {0x92, second_byte, third_byte, forth_byte});
+                {(unsigned char)(instruction.pc_relative ? 0x91 : 0x92),
+                 second_byte, third_byte, forth_byte});
             lc += 4;
             break;
         case LIT_DIR:
@@ -691,8 +1254,7 @@ void Assembler::ld_instruction(Instruction instruction) {
                 lc += 4;
             } else {
                 // reg[A] = literal
-                int offset_to_literal =
-                    current_section->literal_pool[op.literal] - lc - 4;
+                int offset_to_literal = literal_offset(op.literal);
                 second_byte = ((destination << 4) & 0xF0) | (pc & 0x0F);
                 third_byte = (offset_to_literal >> 8) & 0x0F;
                 forth_byte = offset_to_literal & 0xFF;
@@ -707,13 +1269,17 @@ void Assembler::ld_instruction(Instruction instruction) {
             }
             break;
         case SYM_DIR:
-            // reg[A] = symbol_value
-            offset_to_symbol = current_section->symbol_pool[op.symbol] - lc - 4;
+            // reg[A] = mem[pc + offset], or reg[A] = symbol_value
+            offset_to_symbol = symbol_offset(instruction);
             second_byte = ((destination << 4) & 0xF0) | (pc & 0x0F);
             third_byte = (offset_to_symbol >> 8) & 0x0F;
             forth_byte = offset_to_symbol & 0xFF;
             current_section->add_bytes(
                 {0x92, second_byte, third_byte, forth_byte});
+            if (instruction.pc_relative) {
+                lc += 4;
+                break;
+            }
 
             // reg[A] = mem[reg[A]]
             second_byte = ((destination << 4) & 0xF0) | (destination & 0x0F);
@@ -752,28 +1318,28 @@ void Assembler::ld_instruction(Instruction instruction) {
             break;
         }
     } else {
-        Operand op = instruction.operand;
+        const Operand &op = instruction.operand;
         switch (instruction.operand.adressing_mode) {
         case IMMED:
             if (!fits_12_bits(op.literal)) {
-                current_section->register_literal(op.literal);
+                literal_used(op.literal);
             }
             lc += 4;
             break;
         case SYMBOL:
-            symbol_used(op.symbol);
+            symbol_used(instruction);
             lc += 4;
             break;
         case LIT_DIR:
             if (!fits_12_bits(op.literal)) {
-                current_section->register_literal(op.literal);
+                literal_used(op.literal);
                 lc += 4;
             }
             lc += 4;
             break;
         case SYM_DIR:
-            symbol_used(op.symbol);
-            lc += 8;
+            symbol_used(instruction);
+            lc += instruction.pc_relative ? 4 : 8;
             break;
         case REGDIR:
         case REGIND:
@@ -788,8 +1354,8 @@ void Assembler::ld_instruction(Instruction instruction) {
     }
 }
 
-void Assembler::st_instruction(Instruction instruction) {
-    Operand op = instruction.operand;
+void Assembler::st_instruction(const Instruction &instruction) {
+    const Operand &op = instruction.operand;
     if (second_pass) {
         unsigned char source = instruction.gpr1;
         unsigned char second_byte;
@@ -816,8 +1382,7 @@ void Assembler::st_instruction(Instruction instruction) {
                     {0x80, 0x00, third_byte, forth_byte});
 
             } else {
-                int offset_to_literal =
-                    current_section->literal_pool[op.literal] - lc - 4;
+                int offset_to_literal = literal_offset(op.literal);
                 second_byte = (pc << 4) & 0xF0;
                 third_byte =
                     ((source << 4) & 0xF0) | (offset_to_literal >> 8) & 0x0F;
@@ -828,13 +1393,14 @@ void Assembler::st_instruction(Instruction instruction) {
             lc += 4;
             break;
         case SYM_DIR:
-            offset_to_symbol = current_section->symbol_pool[op.symbol] - lc - 4;
+            offset_to_symbol = symbol_offset(instruction);
             second_byte = (pc << 4) & 0xF0;
             third_byte =
                 ((source << 4) & 0xF0) | ((offset_to_symbol >> 8) & 0x0F);
             forth_byte = offset_to_symbol & 0xFF;
             current_section->add_bytes(
-                {0x82, second_byte, third_byte, forth_byte});
+                {(unsigned char)(instruction.pc_relative ? 0x80 : 0x82),
+                 second_byte, third_byte, forth_byte});
             lc += 4;
             break;
         case REGDIR:
@@ -879,12 +1445,12 @@ void Assembler::st_instruction(Instruction instruction) {
             break;
         case LIT_DIR:
             if (!fits_12_bits(op.literal)) {
-                current_section->register_literal(op.literal);
+                literal_used(op.literal);
             }
             lc += 4;
             break;
         case SYM_DIR:
-            symbol_used(op.symbol);
+            symbol_used(instruction);
             lc += 4;
             break;
         case REGDIR:
@@ -903,7 +1469,7 @@ void Assembler::st_instruction(Instruction instruction) {
     }
 }
 
-void Assembler::csrrd_instruction(Instruction instruction) {
+void Assembler::csrrd_instruction(const Instruction &instruction) {
     if (second_pass) {
         unsigned char gpr = instruction.gpr1;
         unsigned char csr = instruction.csr;
@@ -914,7 +1480,13 @@ void Assembler::csrrd_instruction(Instruction instruction) {
     lc += 4;
 }
 
-void Assembler::csrwr_instruction(Instruction instruction) {
+void Assembler::csrwr_instruction(const Instruction &instruction) {
+    // %instret, %cycle, %intcount and %coreid
+    if (instruction.csr >= 3 && instruction.csr <= 6) {
+        cout << "CSR " << instruction.csr << " is read-only!" << endl;
+        exit(-1);
+    }
+
     if (second_pass) {
         unsigned char gpr = instruction.gpr1;
         unsigned char csr = instruction.csr;
@@ -925,34 +1497,115 @@ void Assembler::csrwr_instruction(Instruction instruction) {
     lc += 4;
 }
 
-bool fits_12_bits(int number) { return number >= 0x800 && number <= 0x7FF; }
+bool fits_12_bits(int number) { return number >= -0x800 && number <= 0x7FF; }
+
+unsigned int ObjectTables::add_string(string_view name) {
+    unsigned int offset = strings.size();
+    strings.append(name);
+    strings.push_back('\0');
+    return offset;
+}
 
-void print_section(Section &section) {
-    output_file << section.name << "\n";
-    output_file << section.length << "\n";
+template <class Record> static void append_record(string &out, Record record) {
+    out.append((const char *)&record, sizeof(record));
+}
+
+void write_section(Section &section, ObjectTables &tables, string &out) {
+    ObjectSection record;
+    record.name = tables.name(section.name);
+    record.length = section.length;
+    record.relocation_count = section.relocations.size();
+    out.reserve(sizeof(record) + object_align(section.length) +
+                section.relocations.size() * sizeof(ObjectRelocation));
+
+    append_record(out, record);
+    out.append((const char *)section.content.data(), section.content.size());
+    out.resize(sizeof(record) + object_align(section.length), '\0');
+    for (const auto &relocation : section.relocations) {
+        ObjectRelocation entry;
+        entry.offset = relocation.offset;
+        entry.addend = relocation.addend;
+        entry.symbol = tables.index[relocation.symbol];
+        append_record(out, entry);
+    }
+}
+
+// the whole object is put together in memory and written at once
+void write_object(vector<string> &sections, ObjectTables &tables,
+                  vector<LineEntry> &lines, ostream &out) {
+    ObjectHeader header;
+    copy(OBJECT_MAGIC, OBJECT_MAGIC + 4, header.magic);
+    header.version = OBJECT_VERSION;
+    header.string_table_size = tables.strings.size();
+    header.symbol_count = tables.symbols.size();
+    header.section_count = sections.size();
+    header.line_count = lines.size();
+    header.source_file = tables.source_file;
+
+    size_t size = sizeof(header) + object_align(tables.strings.size()) +
+                  tables.symbols.size() * sizeof(ObjectSymbol) +
+                  lines.size() * sizeof(ObjectLine);
+    for (string &section : sections) {
+        size += section.size();
+    }
+
+    string object;
+    object.reserve(size);
+    append_record(object, header);
+    object.append(tables.strings);
+    object.resize(sizeof(header) + object_align(tables.strings.size()), '\0');
+    object.append((const char *)tables.symbols.data(),
+                  tables.symbols.size() * sizeof(ObjectSymbol));
+    for (string &section : sections) {
+        object.append(section);
+    }
+    for (const auto &entry : lines) {
+        ObjectLine line;
+        line.section = tables.name(entry.section);
+        line.offset = entry.offset;
+        line.size = entry.size;
+        line.line = entry.line;
+        append_record(object, line);
+    }
+    out.write(object.data(), object.size());
+}
+
+void print_section(Section &section, Interner &names, ostream &out) {
+    out << names.name(section.name) << "\n";
+    out << section.length << "\n";
     for (unsigned char byte : section.content) {
-        output_file << hex << setw(2) << setfill('0') << (int)byte << ' '
-                    << dec;
+        out << hex << setw(2) << setfill('0') << (int)byte << ' ' << dec;
     }
-    output_file << "\n";
+    out << "\n";
 
     for (const auto &relocation : section.relocations) {
-        output_file << relocation.offset << " " << relocation.addend << " "
-                    << relocation.symbol << "\n";
+        out << relocation.offset << " " << relocation.addend << " "
+            << names.name(relocation.symbol) << "\n";
     }
-    output_file << "---\n";
+    out << "---\n";
 }
 
-void print_symbol_table(unordered_map<string, Symbol> &sym_tab) {
-    output_file << "Symbol table:\n";
-    for (const auto &sym : sym_tab) {
-        if (sym.second.is_global) {
-            output_file << sym.first << " " << sym.second.value << " "
-                        << sym.second.is_defined << " "
-                        << (sym.second.section_name == ""
-                                ? "UND"
-                                : sym.second.section_name)
-                        << "\n";
+void print_symbol_table(vector<Symbol> &sym_tab, Interner &names,
+                        ostream &out) {
+    out << "Symbol table:\n";
+    for (unsigned int name = 0; name < sym_tab.size(); name++) {
+        Symbol &sym = sym_tab[name];
+        if (sym.is_global) {
+            out << names.name(name) << " " << sym.value << " "
+                << sym.is_defined << " "
+                << (sym.section == NO_SECTION ? "UND"
+                                              : names.name(sym.section))
+                << "\n";
         }
     }
 }
+
+void print_line_table(string source_file_name, vector<LineEntry> &lines,
+                      Interner &names, ostream &out) {
+    out << "Line table:\n";
+    out << source_file_name << "\n";
+    for (const auto &entry : lines) {
+        out << names.name(entry.section) << " " << entry.offset << " "
+            << entry.size << " " << entry.line << "\n";
+    }
+}
@@ -0,0 +1,115 @@
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "emulator.hpp"
+
+using namespace std;
+
+BlockDevice::BlockDevice(Memory *mem, Emulator *core, string file_name)
+    : mem(mem), core(core) {
+    fd = open(file_name.c_str(), O_RDWR);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+        cout << "Failed to open file " << file_name << endl;
+        exit(-1);
+    }
+    sectors = file_stat.st_size / SECTOR_SIZE;
+
+    thread(&BlockDevice::work, this).detach();
+}
+
+unsigned int BlockDevice::read_register(unsigned int offset) {
+    lock_guard<mutex> lock(registers_mutex);
+    switch (offset) {
+    case BLOCK_SECTOR:
+        return sector;
+    case BLOCK_COUNT:
+        return count;
+    case BLOCK_BUFFER:
+        return buffer;
+    case BLOCK_COMMAND:
+        return status;
+    case BLOCK_SECTORS:
+        return sectors;
+    default:
+        return 0;
+    }
+}
+
+void BlockDevice::write_register(unsigned int offset, unsigned int value) {
+    lock_guard<mutex> lock(registers_mutex);
+    switch (offset) {
+    case BLOCK_SECTOR:
+        sector = value;
+        break;
+    case BLOCK_COUNT:
+        count = value;
+        break;
+    case BLOCK_BUFFER:
+        buffer = value;
+        break;
+    case BLOCK_COMMAND:
+        if (status == BLOCK_BUSY || command) {
+            break;
+        }
+        if (value == BLOCK_READ || value == BLOCK_WRITE) {
+            status = BLOCK_BUSY;
+            command = value;
+            command_written.notify_one();
+        } else {
+            status = BLOCK_IDLE;
+        }
+        break;
+    }
+}
+
+void BlockDevice::work() {
+    while (true) {
+        unique_lock<mutex> lock(registers_mutex);
+        command_written.wait(lock, [this] { return command != 0; });
+        unsigned int current_command = command;
+        unsigned int current_sector = sector;
+        unsigned int current_count = count;
+        unsigned int current_buffer = buffer;
+        lock.unlock();
+
+        bool success = transfer(current_command, current_sector,
+                                current_count, current_buffer);
+
+        lock.lock();
+        command = 0;
+        status = success ? BLOCK_DONE : BLOCK_ERROR;
+        lock.unlock();
+        core->raise_interrupt(BLOCK);
+    }
+}
+
+bool BlockDevice::transfer(unsigned int command, unsigned int sector,
+                           unsigned int count, unsigned int buffer) {
+    unsigned long length = (unsigned long)count * SECTOR_SIZE;
+    if ((unsigned long)sector + count > sectors || length > 0xFFFFFFFF ||
+        !mem->is_mapped(buffer, length)) {
+        return false;
+    }
+
+    unsigned char *data = mem->host_address(buffer);
+    off_t offset = (off_t)sector * SECTOR_SIZE;
+    while (length > 0) {
+        ssize_t done = command == BLOCK_READ ? pread(fd, data, length, offset)
+                                             : pwrite(fd, data, length, offset);
+        if (done <= 0) {
+            break;
+        }
+        data += done;
+        offset += done;
+        length -= done;
+    }
+
+    if (command == BLOCK_READ) {
+        mem->modified(buffer, (unsigned long)count * SECTOR_SIZE);
+    }
+    return length == 0;
+}
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "bus.hpp"
+
+using namespace std;
+
+void Bus::map(unsigned int start, unsigned int size, Device *device,
+              string name) {
+    if (start < MMIO_START || (unsigned long)start + size > 0x100000000UL) {
+        cout << "Device " << name << " must be mapped above 0x" << hex
+             << MMIO_START << "!" << endl;
+        exit(-1);
+    }
+
+    auto it = upper_bound(
+        regions.begin(), regions.end(), start,
+        [](unsigned int address, Region &region) {
+            return address < region.start;
+        });
+    // ends computed in unsigned long, a region may end at the top of memory
+    unsigned long end = (unsigned long)start + size;
+    if ((it != regions.end() && end > it->start) ||
+        (it != regions.begin() &&
+         (unsigned long)(it - 1)->start + (it - 1)->size > start)) {
+        cout << "Device " << name << " overlaps another device!" << endl;
+        exit(-1);
+    }
+
+    Region region;
+    region.start = start;
+    region.size = size;
+    region.device = device;
+    region.name = name;
+    regions.insert(it, region);
+}
+
+Region *Bus::find(unsigned int address) {
+    auto it = upper_bound(
+        regions.begin(), regions.end(), address,
+        [](unsigned int address, Region &region) {
+            return address < region.start;
+        });
+    if (it == regions.begin() || address - (it - 1)->start >= (it - 1)->size) {
+        return nullptr;
+    }
+    return &*(it - 1);
+}
+
+unsigned int Bus::read_word(unsigned int address) {
+    __atomic_fetch_add(&accesses, 1, __ATOMIC_RELAXED);
+    Region *region = find(address);
+    if (!region) {
+        return mem->read_word(address);
+    }
+    __atomic_fetch_add(&region->accesses, 1, __ATOMIC_RELAXED);
+    return region->device->read_register(address - region->start);
+}
+
+void Bus::write_word(unsigned int address, unsigned int value) {
+    __atomic_fetch_add(&accesses, 1, __ATOMIC_RELAXED);
+    Region *region = find(address);
+    if (!region) {
+        mem->write_word(address, value);
+        return;
+    }
+    __atomic_fetch_add(&region->accesses, 1, __ATOMIC_RELAXED);
+    region->device->write_register(address - region->start, value);
+}
+
+void Bus::tick() {
+    for (Region &region : regions) {
+        region.device->tick();
+    }
+}
+
+void Bus::report(unsigned long ram_accesses) {
+    cout << "-----------------------------------------------------------------"
+         << "\n";
+    cout << "Bus accesses:\n";
+    cout << "RAM: " << dec << ram_accesses << "\n";
+    cout << "MMIO: " << accesses << "\n";
+    for (Region &region : regions) {
+        cout << "  " << region.name << " at 0x" << hex << setw(8)
+             << setfill('0') << region.start << ": " << dec << region.accesses
+             << "\n";
+    }
+}
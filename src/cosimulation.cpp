@@ -0,0 +1,223 @@
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "cosimulation.hpp"
+#include "emulator.hpp"
+
+using namespace std;
+
+static string gpr_name(unsigned char index) {
+    if (index == 14) {
+        return "%sp";
+    }
+    if (index == 15) {
+        return "%pc";
+    }
+    return "%r" + to_string(index);
+}
+
+static string csr_name(unsigned char index) {
+    const char *names[] = {"status",   "handler", "cause",  "instret",
+                           "cycle",    "intcount", "coreid", "ipi"};
+    if (index < 8) {
+        return string("%") + names[index];
+    }
+    return "%csr" + to_string(index);
+}
+
+static string displacement(int d) {
+    stringstream stream;
+    if (d > 0) {
+        stream << " + 0x" << hex << d;
+    } else if (d < 0) {
+        stream << " - 0x" << hex << -d;
+    }
+    return stream.str();
+}
+
+string disassemble(unsigned int word) {
+    DecodedInstruction instruction = decode(word);
+    string a = gpr_name(instruction.a);
+    string b = gpr_name(instruction.b);
+    string c = gpr_name(instruction.c);
+    string d = displacement(instruction.d);
+    string conditions[] = {"", "eq ", "ne ", "gt "};
+    unsigned char mode = instruction.operation & 0x0F;
+
+    switch (instruction.operation) {
+    case HALT << 4:
+        return "halt";
+    case INT << 4:
+        return "int";
+    case CALL << 4 | CALL_DIR:
+        return "call " + a + " + " + b + d;
+    case CALL << 4 | CALL_IND:
+        return "call [" + a + " + " + b + d + "]";
+    case JUMP << 4 | JMP:
+        return "jmp " + a + d;
+    case JUMP << 4 | JEQ:
+    case JUMP << 4 | JNE:
+    case JUMP << 4 | JGT:
+        return "j" + conditions[mode] + b + ", " + c + ", " + a + d;
+    case JUMP << 4 | BRANCH:
+        return "jmp [" + a + d + "]";
+    case JUMP << 4 | BEQ:
+    case JUMP << 4 | BNE:
+    case JUMP << 4 | BGT:
+        return "j" + conditions[mode & 0x3] + b + ", " + c + ", [" + a + d +
+               "]";
+    case XCHG << 4:
+        return "xchg " + b + ", " + c;
+    case ARIT << 4 | ADD:
+        return "add " + a + ", " + b + ", " + c;
+    case ARIT << 4 | SUB:
+        return "sub " + a + ", " + b + ", " + c;
+    case ARIT << 4 | MUL:
+        return "mul " + a + ", " + b + ", " + c;
+    case ARIT << 4 | DIV:
+        return "div " + a + ", " + b + ", " + c;
+    case LOG << 4 | NOT:
+        return "not " + a + ", " + b;
+    case LOG << 4 | AND:
+        return "and " + a + ", " + b + ", " + c;
+    case LOG << 4 | OR:
+        return "or " + a + ", " + b + ", " + c;
+    case LOG << 4 | XOR:
+        return "xor " + a + ", " + b + ", " + c;
+    case SH << 4 | SHL:
+        return "shl " + a + ", " + b + ", " + c;
+    case SH << 4 | SHR:
+        return "shr " + a + ", " + b + ", " + c;
+    case ST << 4 | ST_DIR:
+        return "st " + c + ", [" + a + " + " + b + d + "]";
+    case ST << 4 | ST_IND:
+        return "st " + c + ", [[" + a + " + " + b + d + "]]";
+    case ST << 4 | ST_PUSH:
+        return "st " + c + ", [" + a + d + "]!";
+    case LD << 4 | GPR_CSR:
+        return "csrrd " + csr_name(instruction.b) + ", " + a;
+    case LD << 4 | GPR_GPR:
+        return "ld " + b + d + ", " + a;
+    case LD << 4 | GPR_MEM:
+        return "ld [" + b + " + " + c + d + "], " + a;
+    case LD << 4 | GPR_POP:
+        return "ld [" + b + "]" + d + ", " + a;
+    case LD << 4 | CSR_GPR:
+        return "csrwr " + b + ", " + csr_name(instruction.a);
+    case LD << 4 | CSR_CSR:
+        return "csrwr " + csr_name(instruction.b) + d + ", " +
+               csr_name(instruction.a);
+    case LD << 4 | CSR_MEM:
+        return "csrwr [" + b + " + " + c + d + "], " +
+               csr_name(instruction.a);
+    case LD << 4 | CSR_POP:
+        return "csrwr [" + b + "]" + d + ", " + csr_name(instruction.a);
+    default: {
+        stringstream stream;
+        stream << ".word 0x" << hex << setw(8) << setfill('0') << word;
+        return stream.str();
+    }
+    }
+}
+
+Cosimulation::Cosimulation(Emulator *reference, Emulator *fast)
+    : reference(reference), fast(fast) {}
+
+bool Cosimulation::run() {
+    // the fast core never records coverage
+    if (reference->coverage) {
+        return lockstep<CoveredLogged>();
+    }
+    return lockstep<Logged>();
+}
+
+template <class Policy> bool Cosimulation::lockstep() {
+    for (Emulator *core : {reference, fast}) {
+        core->pc = core->start_address;
+        core->running = true;
+    }
+    reference->write_log = &reference_writes;
+    fast->write_log = &fast_writes;
+
+    while (fast->running) {
+        unsigned int block_address = fast->pc;
+        reference_writes.clear();
+        fast_writes.clear();
+
+        unsigned int executed = fast->engine->execute_block<Logged>();
+        for (unsigned int i = 0; i < executed && reference->running; i++) {
+            reference->execute_instruction<Policy>();
+        }
+        blocks++;
+        instructions += executed;
+
+        if (!matches()) {
+            report_divergence(block_address, executed);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Cosimulation::matches() {
+    for (int i = 0; i < 16; i++) {
+        if (reference->gpr[i] != fast->gpr[i] ||
+            reference->csr[i] != fast->csr[i]) {
+            return false;
+        }
+    }
+    return reference->running == fast->running &&
+           reference_writes == fast_writes;
+}
+
+static void print_writes(string name,
+                         vector<pair<unsigned int, unsigned int>> &writes) {
+    cout << "  " << name << " writes:";
+    if (writes.empty()) {
+        cout << " none";
+    }
+    for (auto &write : writes) {
+        cout << " [0x" << hex << setw(8) << setfill('0') << write.first
+             << "]=0x" << setw(8) << write.second;
+    }
+    cout << "\n";
+}
+
+void Cosimulation::report_divergence(unsigned int block_address,
+                                     unsigned int executed) {
+    cout << "Co-simulation diverged in the block at 0x" << hex << setw(8)
+         << setfill('0') << block_address << " after " << dec << executed
+         << " instructions:\n";
+    for (unsigned int i = 0; i < executed; i++) {
+        unsigned int address = block_address + i * 4;
+        unsigned int word = reference->mem->read_word(address);
+        cout << "  0x" << hex << setw(8) << setfill('0') << address << ": "
+             << setw(8) << word << "  " << disassemble(word) << "\n";
+    }
+
+    cout << "Differences (reference vs fast engine):\n";
+    for (int i = 0; i < 16; i++) {
+        if (reference->gpr[i] != fast->gpr[i]) {
+            cout << "  r" << dec << i << ": 0x" << hex << setw(8)
+                 << setfill('0') << reference->gpr[i] << " vs 0x" << setw(8)
+                 << fast->gpr[i] << "\n";
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        if (reference->csr[i] != fast->csr[i]) {
+            cout << "  " << csr_name(i) << ": 0x" << hex << setw(8)
+                 << setfill('0') << reference->csr[i] << " vs 0x" << setw(8)
+                 << fast->csr[i] << "\n";
+        }
+    }
+    if (reference->running != fast->running) {
+        cout << "  " << (reference->running ? "running" : "halted") << " vs "
+             << (fast->running ? "running" : "halted") << "\n";
+    }
+    if (reference_writes != fast_writes) {
+        print_writes("reference", reference_writes);
+        print_writes("fast engine", fast_writes);
+    }
+    cout << flush;
+}
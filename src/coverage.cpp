@@ -0,0 +1,182 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+
+#include "emulator.hpp"
+
+using namespace std;
+
+// one byte for each of the 2^30 guest words
+const unsigned long COVERAGE_MAP_SIZE = 1UL << 30;
+
+vector<SourceLine> read_line_table(string lines_file_name) {
+    ifstream file(lines_file_name);
+    if (!file) {
+        cout << "Failed to open file " << lines_file_name << endl;
+        exit(-1);
+    }
+
+    vector<SourceLine> lines;
+    string line;
+    while (getline(file, line)) {
+        SourceLine entry;
+        stringstream line_stream(line);
+        if (!(line_stream >> hex >> entry.address >> dec >> entry.size >>
+              entry.line >> ws) ||
+            !getline(line_stream, entry.source_file)) {
+            continue;
+        }
+        lines.push_back(entry);
+    }
+    file.close();
+    return lines;
+}
+
+vector<SourceLine> hex_line_table(string hex_file_name) {
+    ifstream file(hex_file_name);
+    if (!file) {
+        cout << "Failed to open file " << hex_file_name << endl;
+        exit(-1);
+    }
+
+    vector<SourceLine> lines;
+    string line;
+    int line_num = 0;
+    while (getline(file, line)) {
+        line_num++;
+        stringstream line_stream(line);
+        string address_string;
+        if (!(line_stream >> address_string)) {
+            continue;
+        }
+        address_string.pop_back();
+
+        SourceLine entry;
+        entry.address = stoul(address_string, nullptr, 16);
+        entry.size = 0;
+        entry.line = line_num;
+        entry.source_file = hex_file_name;
+        unsigned int byte;
+        while (line_stream >> hex >> byte) {
+            entry.size++;
+        }
+        lines.push_back(entry);
+    }
+    file.close();
+    return lines;
+}
+
+Coverage::Coverage() {
+    unsigned char **maps[] = {&executed_words, &taken_words, &not_taken_words};
+    for (unsigned char **coverage_map : maps) {
+        void *mapping =
+            mmap(nullptr, COVERAGE_MAP_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapping == MAP_FAILED) {
+            cout << "Failed to reserve the coverage map!" << endl;
+            exit(-1);
+        }
+        *coverage_map = (unsigned char *)mapping;
+    }
+}
+
+static bool is_conditional_jump(unsigned int word) {
+    unsigned char operation = word & 0xFF;
+    unsigned char mode = operation & 0x0F;
+    return operation >> 4 == JUMP && mode != JMP && mode != BRANCH &&
+           (mode & 0x7) <= JGT;
+}
+
+void Coverage::report(string output_file_name, Memory *mem,
+                      vector<SourceLine> &lines,
+                      map<string, unsigned int> &symbols) {
+    map<string, vector<SourceLine *>> files;
+    for (SourceLine &line : lines) {
+        files[line.source_file].push_back(&line);
+    }
+
+    ofstream output(output_file_name);
+    if (!output) {
+        cout << "Failed to open file " << output_file_name << endl;
+        exit(-1);
+    }
+
+    unsigned long total_lines = 0, hit_lines = 0;
+    unsigned long total_branches = 0, hit_branches = 0;
+    output << "TN:\n";
+    for (auto &file : files) {
+        output << "SF:" << file.first << "\n";
+
+        // functions are the symbols that start one of the lines
+        int functions = 0, hit_functions = 0;
+        for (auto &symbol : symbols) {
+            for (SourceLine *line : file.second) {
+                if (symbol.second - line->address < line->size) {
+                    bool hit = executed_words[symbol.second >> 2];
+                    output << "FN:" << line->line << "," << symbol.first
+                           << "\n";
+                    output << "FNDA:" << hit << "," << symbol.first << "\n";
+                    functions++;
+                    hit_functions += hit;
+                    break;
+                }
+            }
+        }
+        output << "FNF:" << functions << "\nFNH:" << hit_functions << "\n";
+
+        map<int, bool> line_hits;
+        int branches = 0, taken_branches = 0;
+        for (SourceLine *line : file.second) {
+            bool hit = false;
+            int block = 0;
+            for (unsigned long address = line->address;
+                 address < (unsigned long)line->address + line->size;
+                 address += 4) {
+                bool executed = executed_words[address >> 2];
+                hit |= executed;
+                if (!is_conditional_jump(mem->read_word(address))) {
+                    continue;
+                }
+
+                // branch 0 is the taken edge, branch 1 the fall through
+                unsigned char outcomes[] = {taken_words[address >> 2],
+                                            not_taken_words[address >> 2]};
+                for (int edge = 0; edge < 2; edge++) {
+                    output << "BRDA:" << line->line << "," << block << ","
+                           << edge << ",";
+                    if (executed) {
+                        output << (int)outcomes[edge] << "\n";
+                    } else {
+                        output << "-\n";
+                    }
+                    branches++;
+                    taken_branches += outcomes[edge];
+                }
+                block++;
+            }
+            line_hits[line->line] |= hit;
+        }
+        output << "BRF:" << branches << "\nBRH:" << taken_branches << "\n";
+
+        int hit_count = 0;
+        for (auto &line : line_hits) {
+            output << "DA:" << line.first << "," << line.second << "\n";
+            hit_count += line.second;
+        }
+        output << "LF:" << line_hits.size() << "\nLH:" << hit_count << "\n";
+        output << "end_of_record\n";
+
+        total_lines += line_hits.size();
+        hit_lines += hit_count;
+        total_branches += branches;
+        hit_branches += taken_branches;
+    }
+    output.close();
+
+    cout << "-----------------------------------------------------------------"
+         << "\n";
+    cout << "Coverage: " << dec << hit_lines << " of " << total_lines
+         << " lines, " << hit_branches << " of " << total_branches
+         << " branch edges\n";
+}
@@ -0,0 +1,99 @@
+#include <cstring>
+
+#include "emulator.hpp"
+
+using namespace std;
+
+unsigned int DmaController::read_register(unsigned int offset) {
+    lock_guard<mutex> lock(registers_mutex);
+    switch (offset) {
+    case DMA_SOURCE:
+        return source;
+    case DMA_DESTINATION:
+        return destination;
+    case DMA_LENGTH:
+        return length;
+    case DMA_CONTROL:
+        return status;
+    default:
+        return 0;
+    }
+}
+
+void DmaController::write_register(unsigned int offset, unsigned int value) {
+    lock_guard<mutex> lock(registers_mutex);
+    switch (offset) {
+    case DMA_SOURCE:
+        source = value;
+        break;
+    case DMA_DESTINATION:
+        destination = value;
+        break;
+    case DMA_LENGTH:
+        length = value;
+        break;
+    case DMA_CONTROL:
+        if (status != DMA_BUSY) {
+            start(value);
+        }
+        break;
+    }
+}
+
+void DmaController::start(unsigned int control) {
+    if (!(control & DMA_GO)) {
+        status = DMA_IDLE;
+        return;
+    }
+
+    fill = control & DMA_FILL;
+    transferred = 0;
+    // a copy to a higher, overlapping range goes from the end, so each byte
+    // is read before it is overwritten, as with a single memmove
+    backwards = !fill && destination > source &&
+                destination - source < length;
+    if (!mem->is_mapped(destination, length) ||
+        (!fill && !mem->is_mapped(source, length))) {
+        status = DMA_ERROR;
+        core->raise_interrupt(DMA);
+        return;
+    }
+
+    if (rate == 0) {
+        transfer(length);
+        status = DMA_DONE;
+        core->raise_interrupt(DMA);
+        return;
+    }
+
+    status = DMA_BUSY;
+    core->raise_interrupt(DEVICE_TICK);
+}
+
+void DmaController::tick() {
+    lock_guard<mutex> lock(registers_mutex);
+    if (status != DMA_BUSY) {
+        return;
+    }
+
+    transfer(min(rate, length - transferred));
+    if (transferred == length) {
+        status = DMA_DONE;
+        core->raise_interrupt(DMA);
+    } else {
+        core->raise_interrupt(DEVICE_TICK);
+    }
+}
+
+void DmaController::transfer(unsigned int bytes) {
+    unsigned int offset =
+        backwards ? length - transferred - bytes : transferred;
+    unsigned char *target = mem->host_address(destination + offset);
+    if (fill) {
+        memset(target, source & 0xFF, bytes);
+    } else {
+        memmove(target, mem->host_address(source + offset), bytes);
+    }
+    mem->modified(destination + offset, bytes);
+    transferred += bytes;
+}
@@ -1,211 +1,845 @@
-#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <regex>
+#include <thread>
 
+#include "cosimulation.hpp"
 #include "emulator.hpp"
 
 using namespace std;
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        cout << "Expected 1 argument, got " << argc - 1 << "!" << endl;
+    string input_file_name;
+    string timing_config;
+    int files = 0;
+    bool semihosting_appeared = false;
+    unsigned int core_count = 1;
+    map<unsigned int, unsigned int> start_options;
+    regex pattern(R"(^-start=([0-9]+)@(0x[0-9a-fA-F]+)$)");
+    string symbols_file_name;
+    string block_file_name;
+    string coverage_file_name;
+    string lines_file_name;
+    vector<pair<unsigned long, unsigned long>> guard_options;
+    vector<pair<unsigned long, unsigned long>> map_options;
+    bool unmapped_guard = false;
+    bool guard_trap = false;
+    regex region_pattern(
+        R"(^-(guard|map|fuzz-buffer)=(0x[0-9a-fA-F]+):(0x[0-9a-fA-F]+)$)");
+    bool fast = false;
+    string server_socket_name;
+    unsigned int server_threads = max(1U, thread::hardware_concurrency());
+    unsigned long server_limit = DEFAULT_INSTRUCTION_LIMIT;
+    string metrics_file_name;
+    string metrics_socket_name;
+    unsigned int metrics_interval = 1000;
+    bool cosim = false;
+    bool dma_appeared = false;
+    bool bus_stats = false;
+    unsigned int dma_rate = 0;
+    vector<pair<string, string>> hook_options;
+    bool hook_verify = false;
+    bool fuzz = false;
+    Fuzzer fuzzer;
+    regex hook_pattern(R"(^-hook=([a-zA-Z0-9_]+)(@(0x[0-9a-fA-F]+))?$)");
+
+    for (int i = 1; i < argc; i++) {
+        string arg = string(argv[i]);
+        if (arg.rfind("-timing=", 0) == 0) {
+            timing_config = arg.substr(string("-timing=").size());
+            continue;
+        }
+
+        if (arg == "-semihosting") {
+            semihosting_appeared = true;
+            continue;
+        }
+
+        if (arg.rfind("-cores=", 0) == 0) {
+            core_count = stoul(arg.substr(string("-cores=").size()));
+            continue;
+        }
+
+        if (arg.rfind("-symbols=", 0) == 0) {
+            symbols_file_name = arg.substr(string("-symbols=").size());
+            continue;
+        }
+
+        if (arg.rfind("-block=", 0) == 0) {
+            block_file_name = arg.substr(string("-block=").size());
+            continue;
+        }
+
+        if (arg.rfind("-server=", 0) == 0) {
+            server_socket_name = arg.substr(string("-server=").size());
+            continue;
+        }
+
+        if (arg.rfind("-server-threads=", 0) == 0) {
+            server_threads =
+                stoul(arg.substr(string("-server-threads=").size()));
+            continue;
+        }
+
+        if (arg.rfind("-server-limit=", 0) == 0) {
+            server_limit = stoul(arg.substr(string("-server-limit=").size()));
+            continue;
+        }
+
+        if (arg.rfind("-metrics=", 0) == 0) {
+            metrics_file_name = arg.substr(string("-metrics=").size());
+            continue;
+        }
+
+        if (arg.rfind("-metrics-socket=", 0) == 0) {
+            metrics_socket_name = arg.substr(string("-metrics-socket=").size());
+            continue;
+        }
+
+        if (arg.rfind("-metrics-interval=", 0) == 0) {
+            metrics_interval =
+                stoul(arg.substr(string("-metrics-interval=").size()));
+            continue;
+        }
+
+        if (arg.rfind("-coverage=", 0) == 0) {
+            coverage_file_name = arg.substr(string("-coverage=").size());
+            continue;
+        }
+
+        if (arg.rfind("-lines=", 0) == 0) {
+            lines_file_name = arg.substr(string("-lines=").size());
+            continue;
+        }
+
+        if (arg == "-unmapped-guard") {
+            unmapped_guard = true;
+            continue;
+        }
+
+        if (arg == "-guard-trap") {
+            guard_trap = true;
+            continue;
+        }
+
+        if (arg == "-bus-stats") {
+            bus_stats = true;
+            continue;
+        }
+
+        if (arg == "-dma") {
+            dma_appeared = true;
+            continue;
+        }
+
+        if (arg.rfind("-dma-rate=", 0) == 0) {
+            dma_appeared = true;
+            dma_rate = stoul(arg.substr(string("-dma-rate=").size()));
+            continue;
+        }
+
+        if (arg == "-fast") {
+            fast = true;
+            continue;
+        }
+
+        if (arg == "-cosim") {
+            cosim = true;
+            continue;
+        }
+
+        if (arg == "-hook-verify") {
+            hook_verify = true;
+            continue;
+        }
+
+        if (arg.rfind("-fuzz-entry=", 0) == 0) {
+            fuzz = true;
+            fuzzer.entry =
+                stoul(arg.substr(string("-fuzz-entry=").size()), nullptr, 16);
+            continue;
+        }
+
+        if (arg.rfind("-fuzz-file=", 0) == 0) {
+            fuzzer.input_file_name = arg.substr(string("-fuzz-file=").size());
+            continue;
+        }
+
+        if (arg.rfind("-fuzz-budget=", 0) == 0) {
+            fuzzer.budget = stoul(arg.substr(string("-fuzz-budget=").size()));
+            continue;
+        }
+
+        if (arg.rfind("-fuzz-iterations=", 0) == 0) {
+            fuzzer.iterations =
+                stoul(arg.substr(string("-fuzz-iterations=").size()));
+            continue;
+        }
+
+        smatch matches;
+        if (regex_match(arg, matches, pattern)) {
+            unsigned int core = stoul(matches[1]);
+            unsigned int address = stoul(matches[2], nullptr, 16);
+            start_options[core] = address;
+            continue;
+        }
+
+        if (regex_match(arg, matches, region_pattern)) {
+            unsigned long start = stoul(matches[2], nullptr, 16);
+            unsigned long size = stoul(matches[3], nullptr, 16);
+            if (matches[1] == "fuzz-buffer") {
+                fuzzer.buffer = start;
+                fuzzer.buffer_size = size;
+            } else {
+                (matches[1] == "guard" ? guard_options : map_options)
+                    .push_back({start, size});
+            }
+            continue;
+        }
+
+        if (regex_match(arg, matches, hook_pattern)) {
+            hook_options.push_back({matches[1], matches[3]});
+            continue;
+        }
+
+        input_file_name = arg;
+        files++;
+    }
+
+    if (!server_socket_name.empty()) {
+        if (files != 0 || server_threads == 0) {
+            cout << "Expected no input file and at least one server thread!"
+                 << endl;
+            return -1;
+        }
+        Server server(server_socket_name, server_threads, server_limit);
+        server.run();
+        return 0;
+    }
+
+    if (files != 1) {
+        cout << "Expected 1 input file, got " << files << "!" << endl;
         return -1;
     }
-    Emulator emulator;
-    emulator.load_memory(argv[1]);
-    emulator.run();
-    return 0;
-}
+    if (core_count == 0 || core_count > 16) {
+        cout << "Number of cores must be between 1 and 16!" << endl;
+        return -1;
+    }
+    if (metrics_interval == 0) {
+        cout << "Metrics interval must be positive!" << endl;
+        return -1;
+    }
+    for (auto &option : start_options) {
+        if (option.first >= core_count) {
+            cout << "Core " << option.first << " doesn't exist!" << endl;
+            return -1;
+        }
+    }
 
-void Emulator::load_memory(string input_file_name) {
-    ifstream file(input_file_name);
-    string line;
-    unsigned int address;
-    while (getline(file, line)) {
-        stringstream line_stream(line);
-        string address_string;
-        line_stream >> address_string;
-        address_string.pop_back();
-        address = stoul(address_string, nullptr, 16);
+    if (fast && !timing_config.empty()) {
+        cout << "-fast can't be combined with -timing!" << endl;
+        return -1;
+    }
+    if (cosim) {
+        // devices, host files and guard pages would see both engines
+        string conflict;
+        if (core_count > 1) {
+            conflict = "-cores";
+        } else if (!timing_config.empty()) {
+            conflict = "-timing";
+        } else if (semihosting_appeared) {
+            conflict = "-semihosting";
+        } else if (!block_file_name.empty()) {
+            conflict = "-block";
+        } else if (dma_appeared) {
+            conflict = "-dma";
+        } else if (!guard_options.empty() || unmapped_guard) {
+            conflict = "guard pages";
+        } else if (bus_stats) {
+            conflict = "-bus-stats";
+        }
+        if (!conflict.empty()) {
+            cout << "-cosim can't be combined with " << conflict << "!"
+                 << endl;
+            return -1;
+        }
+    }
 
-        unsigned int byte;
-        while (line_stream >> hex >> byte) {
-            mem[address] = byte;
-            address++;
+    if (fuzz) {
+        // host reads into guest memory would bypass the snapshot tracking
+        string conflict;
+        if (core_count > 1) {
+            conflict = "-cores";
+        } else if (!timing_config.empty()) {
+            conflict = "-timing";
+        } else if (semihosting_appeared) {
+            conflict = "-semihosting";
+        } else if (!block_file_name.empty()) {
+            conflict = "-block";
+        } else if (dma_appeared) {
+            conflict = "-dma";
+        } else if (cosim) {
+            conflict = "-cosim";
+        }
+        if (!conflict.empty()) {
+            cout << "-fuzz-entry can't be combined with " << conflict << "!"
+                 << endl;
+            return -1;
         }
+        if (fuzzer.buffer_size <= sizeof(unsigned int)) {
+            cout << "Expected a fuzzing buffer larger than its length word!"
+                 << endl;
+            return -1;
+        }
+        fast = true;
+    }
+
+    Memory memory;
+    memory.load_memory(input_file_name);
+    Bus bus(&memory);
+    if (fast || cosim) {
+        memory.track_code();
+    }
+
+    for (auto &guard : guard_options) {
+        memory.protect(guard.first, guard.second);
+    }
+    if (unmapped_guard) {
+        memory.protect_unmapped(map_options);
+    }
+    if (fuzz && !memory.is_mapped(fuzzer.buffer, fuzzer.buffer_size)) {
+        cout << "Fuzzing buffer overlaps a guard page or MMIO!" << endl;
+        return -1;
+    }
+    if (memory.has_guards() || fuzz) {
+        struct sigaction action = {};
+        action.sa_sigaction = Emulator::fault_handler;
+        action.sa_flags = SA_SIGINFO;
+        sigaction(SIGSEGV, &action, nullptr);
+    }
+
+    auto install_hooks = [&](Memory *memory) -> Hooks * {
+        if (hook_options.empty()) {
+            return nullptr;
+        }
+        Hooks *hooks = new Hooks();
+        hooks->verify = hook_verify;
+        if (!symbols_file_name.empty()) {
+            hooks->load_symbols(symbols_file_name);
+        }
+        for (auto &option : hook_options) {
+            if (option.second.empty()) {
+                hooks->install(memory, option.first);
+            } else {
+                hooks->install(memory, option.first,
+                               stoul(option.second, nullptr, 16));
+            }
+        }
+        return hooks;
+    };
+    Hooks *hooks = install_hooks(&memory);
+
+    Semihosting *semihosting = nullptr;
+    if (semihosting_appeared) {
+        semihosting = new Semihosting();
+    }
+
+    Coverage *coverage = nullptr;
+    if (!coverage_file_name.empty()) {
+        coverage = new Coverage();
+    }
+
+    vector<Emulator *> cores;
+    for (unsigned int i = 0; i < core_count; i++) {
+        Emulator *core = new Emulator(&memory, &bus, &cores, i);
+        core->semihosting = semihosting;
+        core->hooks = hooks;
+        core->guard_trap = guard_trap;
+        core->count_accesses = bus_stats;
+        core->coverage = coverage;
+        if (fast) {
+            core->engine = new FastEngine(*core, &memory);
+        }
+        if (start_options.find(i) != start_options.end()) {
+            core->start_address = start_options[i];
+        }
+        if (!timing_config.empty()) {
+            core->timing = new TimingModel();
+            core->timing->load_config(timing_config);
+        }
+        cores.push_back(core);
+    }
+
+    // device interrupts are delivered to core 0
+    if (!block_file_name.empty()) {
+        bus.map(BLOCK_DEVICE_START, BLOCK_DEVICE_SIZE,
+                new BlockDevice(&memory, cores[0], block_file_name), "block");
     }
-    file.close();
+    if (dma_appeared) {
+        bus.map(DMA_START, DMA_SIZE,
+                new DmaController(&memory, cores[0], dma_rate), "dma");
+    }
+
+    MetricsReporter *reporter = nullptr;
+    if (!metrics_file_name.empty() || !metrics_socket_name.empty()) {
+        reporter = new MetricsReporter(&cores, &bus);
+        reporter->file_name = metrics_file_name;
+        reporter->socket_name = metrics_socket_name;
+        reporter->interval = metrics_interval;
+        reporter->start();
+    }
+
+    bool crashed = false;
+    if (fuzz) {
+        crashed = fuzzer.run(cores[0]);
+    } else if (cosim) {
+        Memory *fast_memory = new Memory();
+        fast_memory->load_memory(input_file_name);
+        fast_memory->track_code();
+        Bus *fast_bus = new Bus(fast_memory);
+        vector<Emulator *> *fast_cores = new vector<Emulator *>();
+        Emulator *fast_core =
+            new Emulator(fast_memory, fast_bus, fast_cores, 0);
+        fast_cores->push_back(fast_core);
+        fast_core->hooks = install_hooks(fast_memory);
+        fast_core->start_address = cores[0]->start_address;
+        fast_core->engine = new FastEngine(*fast_core, fast_memory);
+
+        Cosimulation cosimulation(cores[0], fast_core);
+        if (!cosimulation.run()) {
+            return -1;
+        }
+        cout << "Co-simulation: " << dec << cosimulation.blocks
+             << " blocks, " << cosimulation.instructions
+             << " instructions, no divergence" << endl;
+    } else if (core_count == 1) {
+        cores[0]->run();
+    } else {
+        vector<thread> threads;
+        for (Emulator *core : cores) {
+            threads.emplace_back(&Emulator::run, core);
+        }
+        for (thread &t : threads) {
+            t.join();
+        }
+    }
+    if (reporter) {
+        reporter->stop();
+    }
+
+    for (Emulator *core : cores) {
+        core->print_state();
+        if (core->timing) {
+            core->timing->report();
+        }
+    }
+    if (hooks) {
+        hooks->report();
+    }
+    if (coverage) {
+        vector<SourceLine> lines = lines_file_name.empty()
+                                       ? hex_line_table(input_file_name)
+                                       : read_line_table(lines_file_name);
+        map<string, unsigned int> symbols;
+        if (!symbols_file_name.empty()) {
+            symbols = read_symbol_map(symbols_file_name);
+        }
+        coverage->report(coverage_file_name, &memory, lines, symbols);
+    }
+    if (bus_stats) {
+        unsigned long ram_accesses = 0;
+        for (Emulator *core : cores) {
+            ram_accesses += core->ram_accesses;
+        }
+        bus.report(ram_accesses);
+    }
+    for (Emulator *core : cores) {
+        if (core->faulted) {
+            return -1;
+        }
+    }
+    return crashed ? -1 : 0;
 }
 
-void Emulator::print_state() {
-    cout << "-----------------------------------------------------------------"
+void Emulator::print_state(ostream &out) {
+    out << "-----------------------------------------------------------------"
          << "\n";
-    cout << "Emulated processor state:";
+    out << "Emulated processor state";
+    if (cores->size() > 1) {
+        out << " (core " << dec << coreid << ")";
+    }
+    out << ":";
     for (int i = 0; i < 16; i++) {
         if (i % 4 == 0) {
-            cout << "\n";
+            out << "\n";
         }
         if (i < 10) {
-            cout << " ";
+            out << " ";
         }
-        cout << "r" << dec << i << "=0x" << hex << setw(8) << setfill('0')
+        out << "r" << dec << i << "=0x" << hex << setw(8) << setfill('0')
              << gpr[i] << "\t";
     }
-    cout << "\n";
+    out << "\n";
 }
 
+thread_local Emulator *current_core = nullptr;
+
 void Emulator::run() {
-    for (int i = 0; i < 16; i++) {
-        gpr[i] = 0;
+    pc = start_address;
+    resume();
+}
+
+// continues from the current state, without resetting pc
+void Emulator::resume() {
+    running = true;
+    current_core = this;
+
+    // Guard page faults resume here. Nothing on the way from the access
+    // owns memory, and stores update the core and the write log only once
+    // they are done, so jumping over them loses nothing.
+    if (sigsetjmp(fault_jump, 1)) {
+        guard_fault();
     }
-    for (int i = 0; i < 3; i++) {
-        csr[i] = 0;
+    select_loop<>();
+}
+
+template <bool... chosen> void Emulator::select_loop() {
+    constexpr unsigned int decided = sizeof...(chosen);
+    if constexpr (decided == 4) {
+        run_loop<Instrumentation<chosen...>>();
+    } else {
+        bool enabled[] = {timing != nullptr, coverage != nullptr,
+                          write_log != nullptr, count_accesses};
+        if (enabled[decided]) {
+            select_loop<chosen..., true>();
+        } else {
+            select_loop<chosen..., false>();
+        }
+    }
+}
+
+template <class Policy> void Emulator::run_loop() {
+    if constexpr (!Policy::timed) {
+        if (engine) {
+            while (running && metrics.instructions < instruction_limit) {
+                engine->execute_block<Policy>();
+            }
+            return;
+        }
+    }
+    while (running && metrics.instructions < instruction_limit) {
+        execute_instruction<Policy>();
+    }
+}
+
+// runs from the start address until pc reaches the given address, returns
+// false if the core stopped first
+bool Emulator::run_to(unsigned int address) {
+    pc = start_address;
+    running = true;
+    current_core = this;
+    if (sigsetjmp(fault_jump, 1)) {
+        guard_fault();
+    }
+    while (running && pc != address) {
+        execute_instruction<Plain>();
     }
-    pc = 0x40000000;
+    return running;
+}
+
+void Emulator::fault_handler(int, siginfo_t *info, void *) {
+    Emulator *core = current_core;
+    // first write to a page since the last snapshot
+    if (core && core->mem->write_fault(info->si_addr)) {
+        return;
+    }
+    if (core && core->mem->contains(info->si_addr)) {
+        core->fault_address = core->mem->guest_address(info->si_addr);
+        siglongjmp(core->fault_jump, 1);
+    }
+
+    // not a guest access, let the fault kill the emulator as usual
+    struct sigaction action = {};
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGSEGV, &action, nullptr);
+}
 
-    while (true) {
-        execute_instruction();
+void Emulator::guard_fault() {
+    if (engine) {
+        engine->abandon_block();
     }
+    if (!guard_trap || in_guard_fault) {
+        cout << "Guard page fault at 0x" << hex << setw(8) << setfill('0')
+             << fault_address << ", pc=0x" << setw(8) << instruction_address
+             << endl;
+        faulted = true;
+        running = false;
+        in_guard_fault = false;
+        return;
+    }
+
+    // registers updated by the instruction before the access are kept, a
+    // fault while entering the handler comes back here and stops the core
+    in_guard_fault = true;
+    pc = instruction_address;
+    interrupt<Plain>(MEMORY_FAULT);
+    in_guard_fault = false;
+}
+
+void Emulator::raise_interrupt(unsigned int interrupt_cause) {
+    pending_interrupts.fetch_or(1 << interrupt_cause);
 }
 
-void Emulator::execute_instruction() {
-    vector<unsigned char> bytes;
-    for (int i = 0; i < 4; i++) {
-        bytes.push_back(mem[pc]);
-        pc++;
+void Emulator::send_ipi(unsigned int target) {
+    if (target < cores->size()) {
+        (*cores)[target]->raise_interrupt(INTERPROCESSOR);
     }
+}
 
-    switch ((bytes[0] >> 4) & 0x0F) {
+template <class Policy> void Emulator::execute_instruction() {
+    instruction_address = pc;
+    unsigned int word = mem->read_word(pc);
+    if constexpr (Policy::covered) {
+        coverage->executed(pc);
+    }
+    pc += 4;
+    if constexpr (Policy::timed) {
+        timing->fetch(pc - 4, word & 0xFF);
+    }
+
+    execute_word<Policy>(word);
+
+    instret++;
+    count(metrics.instructions);
+    if constexpr (Policy::timed) {
+        cycle = timing->cycles;
+    } else {
+        cycle++;
+    }
+
+    if (pending_interrupts.load(memory_order_relaxed)) {
+        accept_interrupt<Policy>();
+    }
+}
+
+template <class Policy> void Emulator::execute_word(unsigned int word) {
+    DecodedInstruction instruction = decode(word);
+
+    switch (instruction.operation >> 4) {
     case HALT:
-        print_state();
-        exit(0);
+        running = false;
         break;
     case INT:
-        int_instruction();
+        int_instruction<Policy>();
         break;
     case CALL:
-        call_instruction(bytes);
+        call_instruction<Policy>(instruction);
         break;
     case JUMP:
-        jmp_instruction(bytes);
+        jmp_instruction<Policy>(instruction);
         break;
     case XCHG:
-        xchg_instruction(bytes);
+        xchg_instruction<Policy>(instruction);
         break;
     case ARIT:
-        arit_instruction(bytes);
+        arit_instruction<Policy>(instruction);
         break;
     case LOG:
-        log_instruction(bytes);
+        log_instruction<Policy>(instruction);
         break;
     case SH:
-        sh_instruction(bytes);
+        sh_instruction<Policy>(instruction);
         break;
     case ST:
-        st_instruction(bytes);
+        st_instruction<Policy>(instruction);
         break;
     case LD:
-        ld_instruction(bytes);
+        ld_instruction<Policy>(instruction);
+        break;
+    case HOOK:
+        hook_instruction<Policy>(word);
         break;
     default:
-        invalid_instruction();
+        invalid_instruction<Policy>();
         break;
     }
 }
 
-void Emulator::int_instruction() {
-    push(pc);
-    push(status);
-    cause = 4;
-    status = status & (~0x1);
-    pc = handle;
+template <class Policy> void Emulator::hook_instruction(unsigned int word) {
+    unsigned int index = word >> 8;
+    if (!hooks || index >= hooks->hooks.size()) {
+        invalid_instruction<Policy>();
+        return;
+    }
+
+    Hook &hook = *hooks->hooks[index];
+    hook.calls++;
+    if (!hooks->verify) {
+        if (!hook.native(*this)) {
+            execute_word<Policy>(hook.original);
+        }
+        return;
+    }
+
+    // run the native version on a copy of the registers, then the guest
+    // version up to its return, and compare the two register files
+    unsigned int saved_gpr[16];
+    unsigned int native_gpr[16];
+    copy(gpr, gpr + 16, saved_gpr);
+    if (!hook.native(*this)) {
+        execute_word<Policy>(hook.original);
+        return;
+    }
+    copy(gpr, gpr + 16, native_gpr);
+    copy(saved_gpr, saved_gpr + 16, gpr);
+
+    execute_word<Policy>(hook.original);
+    while (running && !(pc == native_gpr[15] && sp == native_gpr[14])) {
+        execute_instruction<Policy>();
+    }
+
+    for (int i = 0; i < 16; i++) {
+        if (gpr[i] != native_gpr[i]) {
+            hook.mismatches++;
+            cout << "Hook " << hook.name << " mismatch: r" << dec << i
+                 << " guest=0x" << hex << setw(8) << setfill('0') << gpr[i]
+                 << " native=0x" << setw(8) << native_gpr[i] << endl;
+        }
+    }
+}
+
+unsigned int Emulator::hook_argument(int index) {
+    return mem->read_word(sp + (index + 1) * sizeof(unsigned int));
+}
+
+void Emulator::hook_return(unsigned int result) {
+    set_gpr(1, result);
+    pc = mem->read_word(sp);
+    sp += sizeof(unsigned int);
+}
+
+template <class Policy> void Emulator::accept_interrupt() {
+    unsigned int pending = pending_interrupts.load();
+    if (pending & (1 << DEVICE_TICK)) {
+        pending_interrupts.fetch_and(~(1 << DEVICE_TICK));
+        pending &= ~(1 << DEVICE_TICK);
+        bus->tick();
+    }
+
+    if (!pending || (status & 0x4)) {
+        return;
+    }
+
+    unsigned int interrupt_cause = __builtin_ctz(pending);
+    pending_interrupts.fetch_and(~(1 << interrupt_cause));
+    interrupt<Policy>(interrupt_cause);
 }
 
-void Emulator::call_instruction(vector<unsigned char> &bytes) {
-    unsigned char a = (bytes[1] >> 4) & 0x0F;
-    unsigned char b = bytes[1] & 0x0F;
-    int d = ((bytes[2] << 8) & 0xF00) | bytes[3];
+template <class Policy>
+void Emulator::interrupt(unsigned int interrupt_cause) {
+    push<Policy>(pc);
+    push<Policy>(status);
+    cause = interrupt_cause;
+    intcount++;
+    count(metrics.interrupts[interrupt_cause]);
+    status = status & (~0x1);
+    if (status & VECTORED) {
+        pc = read_word<Policy>(handle + interrupt_cause * 4);
+    } else {
+        pc = handle;
+    }
+}
 
-    if (d & 0x800) {
-        d |= 0xFFFFF000;
+template <class Policy> void Emulator::int_instruction() {
+    if (semihosting && (gpr[1] & 0xFFFF0000) == SEMIHOSTING_MAGIC) {
+        gpr[1] = semihosting->call(mem, gpr[1] & 0xFFFF, gpr[2]);
+        return;
     }
+    interrupt<Policy>(SOFTWARE);
+}
+
+template <class Policy>
+void Emulator::call_instruction(DecodedInstruction &instruction) {
+    unsigned char a = instruction.a;
+    unsigned char b = instruction.b;
+    int d = instruction.d;
 
-    push(pc);
-    switch (bytes[0] & 0x0F) {
+    push<Policy>(pc);
+    switch (instruction.operation & 0x0F) {
     case CALL_DIR:
         pc = gpr[a] + gpr[b] + d;
         break;
     case CALL_IND:
-        pc = read_word(gpr[a] + gpr[b] + d);
+        pc = read_word<Policy>(gpr[a] + gpr[b] + d);
         break;
     default:
-        invalid_instruction();
+        invalid_instruction<Policy>();
         break;
     }
 }
 
-void Emulator::jmp_instruction(vector<unsigned char> &bytes) {
-    unsigned char a = (bytes[1] >> 4) & 0x0F;
-    unsigned char b = bytes[1] & 0x0F;
-    unsigned char c = (bytes[2] >> 4) & 0x0F;
-    int d = ((bytes[2] << 8) & 0xF00) | bytes[3];
-
-    if (d & 0x800) {
-        d |= 0xFFFFF000;
-    }
+template <class Policy>
+void Emulator::jmp_instruction(DecodedInstruction &instruction) {
+    unsigned char a = instruction.a;
+    unsigned char b = instruction.b;
+    unsigned char c = instruction.c;
+    int d = instruction.d;
 
-    switch (bytes[0] & 0x0F) {
+    switch (instruction.operation & 0x0F) {
     case JMP:
         pc = gpr[a] + d;
         break;
     case JEQ:
-        if (gpr[b] == gpr[c])
+        if (branch<Policy>(gpr[b] == gpr[c]))
             pc = gpr[a] + d;
         break;
     case JNE:
-        if (gpr[b] != gpr[c])
+        if (branch<Policy>(gpr[b] != gpr[c]))
             pc = gpr[a] + d;
         break;
     case JGT:
-        if ((int)gpr[b] > (int)gpr[c])
+        if (branch<Policy>((int)gpr[b] > (int)gpr[c]))
             pc = gpr[a] + d;
         break;
     case BRANCH:
-        pc = read_word(gpr[a] + d);
+        pc = read_word<Policy>(gpr[a] + d);
         break;
     case BEQ:
-        if (gpr[b] == gpr[c])
-            pc = read_word(gpr[a] + d);
+        if (branch<Policy>(gpr[b] == gpr[c]))
+            pc = read_word<Policy>(gpr[a] + d);
         break;
     case BNE:
-        if (gpr[b] != gpr[c])
-            pc = read_word(gpr[a] + d);
+        if (branch<Policy>(gpr[b] != gpr[c]))
+            pc = read_word<Policy>(gpr[a] + d);
         break;
     case BGT:
-        if ((int)gpr[b] > (int)gpr[c])
-            pc = read_word(gpr[a] + d);
+        if (branch<Policy>((int)gpr[b] > (int)gpr[c]))
+            pc = read_word<Policy>(gpr[a] + d);
         break;
     default:
-        invalid_instruction();
+        invalid_instruction<Policy>();
         break;
     }
 }
 
-void Emulator::xchg_instruction(vector<unsigned char> &bytes) {
-    unsigned char b = bytes[1] & 0x0F;
-    unsigned char c = (bytes[2] >> 4) & 0x0F;
+template <class Policy>
+void Emulator::xchg_instruction(DecodedInstruction &instruction) {
+    unsigned char b = instruction.b;
+    unsigned char c = instruction.c;
 
     unsigned int temp = gpr[b];
     set_gpr(b, gpr[c]);
     set_gpr(c, temp);
 }
 
-void Emulator::arit_instruction(vector<unsigned char> &bytes) {
-    unsigned char a = (bytes[1] >> 4) & 0x0F;
-    unsigned char b = bytes[1] & 0x0F;
-    unsigned char c = (bytes[2] >> 4) & 0x0F;
+template <class Policy>
+void Emulator::arit_instruction(DecodedInstruction &instruction) {
+    unsigned char a = instruction.a;
+    unsigned char b = instruction.b;
+    unsigned char c = instruction.c;
 
-    switch (bytes[0] & 0x0F) {
+    switch (instruction.operation & 0x0F) {
     case ADD:
         set_gpr(a, gpr[b] + gpr[c]);
         break;
@@ -216,20 +850,26 @@ void Emulator::arit_instruction(vector<unsigned char> &bytes) {
         set_gpr(a, gpr[b] * gpr[c]);
         break;
     case DIV:
-        set_gpr(a, gpr[b] / gpr[c]);
+        // division by zero traps like an invalid instruction
+        if (gpr[c] == 0) {
+            invalid_instruction<Policy>();
+        } else {
+            set_gpr(a, gpr[b] / gpr[c]);
+        }
         break;
     default:
-        invalid_instruction();
+        invalid_instruction<Policy>();
         break;
     }
 }
 
-void Emulator::log_instruction(vector<unsigned char> &bytes) {
-    unsigned char a = (bytes[1] >> 4) & 0x0F;
-    unsigned char b = bytes[1] & 0x0F;
-    unsigned char c = (bytes[2] >> 4) & 0x0F;
+template <class Policy>
+void Emulator::log_instruction(DecodedInstruction &instruction) {
+    unsigned char a = instruction.a;
+    unsigned char b = instruction.b;
+    unsigned char c = instruction.c;
 
-    switch (bytes[0] & 0x0F) {
+    switch (instruction.operation & 0x0F) {
     case NOT:
         set_gpr(a, ~gpr[b]);
         break;
@@ -243,17 +883,18 @@ void Emulator::log_instruction(vector<unsigned char> &bytes) {
         set_gpr(a, gpr[b] ^ gpr[c]);
         break;
     default:
-        invalid_instruction();
+        invalid_instruction<Policy>();
         break;
     }
 }
 
-void Emulator::sh_instruction(vector<unsigned char> &bytes) {
-    unsigned char a = (bytes[1] >> 4) & 0x0F;
-    unsigned char b = bytes[1] & 0x0F;
-    unsigned char c = (bytes[2] >> 4) & 0x0F;
+template <class Policy>
+void Emulator::sh_instruction(DecodedInstruction &instruction) {
+    unsigned char a = instruction.a;
+    unsigned char b = instruction.b;
+    unsigned char c = instruction.c;
 
-    switch (bytes[0] & 0x0F) {
+    switch (instruction.operation & 0x0F) {
     case SHL:
         set_gpr(a, gpr[b] << gpr[c]);
         break;
@@ -261,49 +902,43 @@ void Emulator::sh_instruction(vector<unsigned char> &bytes) {
         set_gpr(a, gpr[b] >> gpr[c]);
         break;
     default:
-        invalid_instruction();
+        invalid_instruction<Policy>();
         break;
     }
 }
 
-void Emulator::st_instruction(vector<unsigned char> &bytes) {
-    unsigned char a = (bytes[1] >> 4) & 0x0F;
-    unsigned char b = bytes[1] & 0x0F;
-    unsigned char c = (bytes[2] >> 4) & 0x0F;
-    int d = ((bytes[2] << 8) & 0xF00) | bytes[3];
-
-    if (d & 0x800) {
-        d |= 0xFFFFF000;
-    }
+template <class Policy>
+void Emulator::st_instruction(DecodedInstruction &instruction) {
+    unsigned char a = instruction.a;
+    unsigned char b = instruction.b;
+    unsigned char c = instruction.c;
+    int d = instruction.d;
 
-    switch (bytes[0] & 0x0F) {
+    switch (instruction.operation & 0x0F) {
     case ST_DIR:
-        write_word(gpr[a] + gpr[b] + d, gpr[c]);
+        write_word<Policy>(gpr[a] + gpr[b] + d, gpr[c]);
         break;
     case ST_IND:
-        write_word(read_word(gpr[a] + gpr[b] + d), gpr[c]);
+        write_word<Policy>(read_word<Policy>(gpr[a] + gpr[b] + d), gpr[c]);
         break;
     case ST_PUSH:
         set_gpr(a, (int)gpr[a] + d);
-        write_word(gpr[a], gpr[c]);
+        write_word<Policy>(gpr[a], gpr[c]);
         break;
     default:
-        invalid_instruction();
+        invalid_instruction<Policy>();
         break;
     }
 }
 
-void Emulator::ld_instruction(vector<unsigned char> &bytes) {
-    unsigned char a = (bytes[1] >> 4) & 0x0F;
-    unsigned char b = bytes[1] & 0x0F;
-    unsigned char c = (bytes[2] >> 4) & 0x0F;
-    int d = ((bytes[2] << 8) & 0xF00) | bytes[3];
-
-    if (d & 0x800) {
-        d |= 0xFFFFF000;
-    }
+template <class Policy>
+void Emulator::ld_instruction(DecodedInstruction &instruction) {
+    unsigned char a = instruction.a;
+    unsigned char b = instruction.b;
+    unsigned char c = instruction.c;
+    int d = instruction.d;
 
-    switch (bytes[0] & 0x0F) {
+    switch (instruction.operation & 0x0F) {
     case GPR_CSR:
         set_gpr(a, csr[b]);
         break;
@@ -311,35 +946,51 @@ void Emulator::ld_instruction(vector<unsigned char> &bytes) {
         set_gpr(a, gpr[b] + d);
         break;
     case GPR_MEM:
-        set_gpr(a, read_word(gpr[b] + gpr[c] + d));
+        set_gpr(a, read_word<Policy>(gpr[b] + gpr[c] + d));
         break;
     case GPR_POP:
-        set_gpr(a, read_word(gpr[b]));
+        set_gpr(a, read_word<Policy>(gpr[b]));
         set_gpr(b, gpr[b] + d);
         break;
     case CSR_GPR:
-        csr[a] = gpr[b];
+        set_csr(a, gpr[b]);
         break;
     case CSR_CSR:
-        csr[a] = csr[b] + d;
+        set_csr(a, csr[b] + d);
         break;
     case CSR_MEM:
-        csr[a] = read_word(gpr[b] + gpr[c] + d);
+        set_csr(a, read_word<Policy>(gpr[b] + gpr[c] + d));
         break;
     case CSR_POP:
-        csr[a] = read_word(gpr[b]);
+        set_csr(a, read_word<Policy>(gpr[b]));
         set_gpr(b, gpr[b] + d);
         break;
     default:
-        invalid_instruction();
+        invalid_instruction<Policy>();
         break;
     }
 }
 
-void Emulator::invalid_instruction() {
-    push(pc);
-    push(status);
-    cause = 1;
-    status = status & (~0x1);
-    pc = handle;
-}
\ No newline at end of file
+template <class Policy> void Emulator::invalid_instruction() {
+    interrupt<Policy>(INVALID);
+}
+
+// used by the fast engine and the co-simulation checker
+template void Emulator::execute_instruction<Logged>();
+template void Emulator::execute_instruction<CoveredLogged>();
+template void Emulator::execute_word<Plain>(unsigned int word);
+template void Emulator::execute_word<Covered>(unsigned int word);
+template void Emulator::execute_word<Logged>(unsigned int word);
+template void Emulator::execute_word<CoveredLogged>(unsigned int word);
+template void Emulator::execute_word<Counted>(unsigned int word);
+template void Emulator::execute_word<CoveredCounted>(unsigned int word);
+template void Emulator::execute_word<LoggedCounted>(unsigned int word);
+template void Emulator::execute_word<CoveredLoggedCounted>(unsigned int word);
+template void Emulator::accept_interrupt<Plain>();
+template void Emulator::accept_interrupt<Covered>();
+template void Emulator::accept_interrupt<Logged>();
+template void Emulator::accept_interrupt<CoveredLogged>();
+template void Emulator::accept_interrupt<Counted>();
+template void Emulator::accept_interrupt<CoveredCounted>();
+template void Emulator::accept_interrupt<LoggedCounted>();
+template void Emulator::accept_interrupt<CoveredLoggedCounted>();
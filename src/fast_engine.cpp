@@ -0,0 +1,259 @@
+#include "emulator.hpp"
+
+using namespace std;
+
+const unsigned int MAX_BLOCK_INSTRUCTIONS = 64;
+
+static bool ends_block(unsigned char operation) {
+    switch (operation >> 4) {
+    case ARIT:
+    case LOG:
+    case SH:
+    case ST:
+    case LD:
+        return false;
+    case XCHG:
+        return operation != XCHG << 4;
+    default:
+        return true;
+    }
+}
+
+FastEngine::FastEngine(Emulator &core, Memory *mem)
+    : core(core), mem(mem), generation(mem->code_generation.load()) {}
+
+void FastEngine::flush() {
+    blocks.clear();
+    generation = mem->code_generation.load();
+    count(core.metrics.block_flushes);
+}
+
+Block &FastEngine::lookup(unsigned int address) {
+    auto found = blocks.find(address);
+    if (found != blocks.end()) {
+        count(core.metrics.block_hits);
+        return found->second;
+    }
+
+    // the first fetch may hit a guard page before the block owns any memory,
+    // the rest stop before one
+    Block block;
+    unsigned int current = address;
+    while (true) {
+        // marked before reading, so a racing write either lands before the
+        // read or sees the mark
+        mem->mark_code(current);
+        mem->mark_code(current + 3);
+        DecodedInstruction instruction = decode(mem->read_word(current));
+        block.instructions.push_back(instruction);
+        if (ends_block(instruction.operation) ||
+            block.instructions.size() == MAX_BLOCK_INSTRUCTIONS) {
+            break;
+        }
+        current += 4;
+        if (current >= MMIO_START || !mem->is_mapped(current, 4)) {
+            break;
+        }
+    }
+
+    count(core.metrics.block_misses);
+    return blocks[address] = move(block);
+}
+
+template <class Policy> unsigned int FastEngine::execute_block() {
+    if (mem->code_generation.load(memory_order_relaxed) != generation) {
+        flush();
+    }
+
+    block_address = core.pc;
+    block_instret = core.instret;
+    if (core.edges) {
+        core.edges->visit(block_address);
+    }
+    Block &block = lookup(block_address);
+    unsigned int executed = 0;
+    for (DecodedInstruction &instruction : block.instructions) {
+        core.instruction_address = core.pc;
+        unsigned int next = core.pc + 4;
+        core.pc = next;
+        bool stop = execute<Policy>(instruction);
+        core.instret++;
+        core.cycle++;
+        executed++;
+
+        if (core.pending_interrupts.load(memory_order_relaxed)) {
+            core.accept_interrupt<Policy>();
+            break;
+        }
+        if (stop || core.pc != next) {
+            break;
+        }
+    }
+    count(core.metrics.instructions, executed);
+    if constexpr (Policy::covered) {
+        for (unsigned int i = 0; i < executed; i++) {
+            core.coverage->executed(block_address + i * 4);
+        }
+    }
+    return executed;
+}
+
+// a guard fault left the current block, the instructions before the
+// faulting one still count
+void FastEngine::abandon_block() {
+    unsigned long executed = core.instret - block_instret;
+    count(core.metrics.instructions, executed);
+    if (core.coverage) {
+        for (unsigned long i = 0; i < executed; i++) {
+            core.coverage->executed(block_address + i * 4);
+        }
+    }
+    block_instret = core.instret;
+}
+
+// returns true once the write changed code that may have been decoded
+template <class Policy>
+bool FastEngine::store(unsigned int address, unsigned int value) {
+    core.write_word<Policy>(address, value);
+    return mem->code_generation.load(memory_order_relaxed) != generation;
+}
+
+// returns true when the rest of the block must not run
+template <class Policy>
+bool FastEngine::execute(DecodedInstruction &instruction) {
+    unsigned int *gpr = core.gpr;
+    unsigned char a = instruction.a;
+    unsigned char b = instruction.b;
+    unsigned char c = instruction.c;
+    int d = instruction.d;
+
+    switch (instruction.operation) {
+    case HALT << 4:
+        core.running = false;
+        return true;
+    case CALL << 4 | CALL_DIR:
+        core.push<Policy>(core.pc);
+        core.pc = gpr[a] + gpr[b] + d;
+        return true;
+    case CALL << 4 | CALL_IND:
+        core.push<Policy>(core.pc);
+        core.pc = core.read_word<Policy>(gpr[a] + gpr[b] + d);
+        return true;
+    case JUMP << 4 | JMP:
+        core.pc = gpr[a] + d;
+        return true;
+    case JUMP << 4 | JEQ:
+        if (core.branch<Policy>(gpr[b] == gpr[c]))
+            core.pc = gpr[a] + d;
+        return true;
+    case JUMP << 4 | JNE:
+        if (core.branch<Policy>(gpr[b] != gpr[c]))
+            core.pc = gpr[a] + d;
+        return true;
+    case JUMP << 4 | JGT:
+        if (core.branch<Policy>((int)gpr[b] > (int)gpr[c]))
+            core.pc = gpr[a] + d;
+        return true;
+    case JUMP << 4 | BRANCH:
+        core.pc = core.read_word<Policy>(gpr[a] + d);
+        return true;
+    case JUMP << 4 | BEQ:
+        if (core.branch<Policy>(gpr[b] == gpr[c]))
+            core.pc = core.read_word<Policy>(gpr[a] + d);
+        return true;
+    case JUMP << 4 | BNE:
+        if (core.branch<Policy>(gpr[b] != gpr[c]))
+            core.pc = core.read_word<Policy>(gpr[a] + d);
+        return true;
+    case JUMP << 4 | BGT:
+        if (core.branch<Policy>((int)gpr[b] > (int)gpr[c]))
+            core.pc = core.read_word<Policy>(gpr[a] + d);
+        return true;
+    case XCHG << 4: {
+        unsigned int temp = gpr[b];
+        core.set_gpr(b, gpr[c]);
+        core.set_gpr(c, temp);
+        return false;
+    }
+    case ARIT << 4 | ADD:
+        core.set_gpr(a, gpr[b] + gpr[c]);
+        return false;
+    case ARIT << 4 | SUB:
+        core.set_gpr(a, gpr[b] - gpr[c]);
+        return false;
+    case ARIT << 4 | MUL:
+        core.set_gpr(a, gpr[b] * gpr[c]);
+        return false;
+    case ARIT << 4 | DIV:
+        if (gpr[c] == 0) {
+            core.execute_word<Policy>(instruction.word);
+            return true;
+        }
+        core.set_gpr(a, gpr[b] / gpr[c]);
+        return false;
+    case LOG << 4 | NOT:
+        core.set_gpr(a, ~gpr[b]);
+        return false;
+    case LOG << 4 | AND:
+        core.set_gpr(a, gpr[b] & gpr[c]);
+        return false;
+    case LOG << 4 | OR:
+        core.set_gpr(a, gpr[b] | gpr[c]);
+        return false;
+    case LOG << 4 | XOR:
+        core.set_gpr(a, gpr[b] ^ gpr[c]);
+        return false;
+    case SH << 4 | SHL:
+        core.set_gpr(a, gpr[b] << gpr[c]);
+        return false;
+    case SH << 4 | SHR:
+        core.set_gpr(a, gpr[b] >> gpr[c]);
+        return false;
+    case ST << 4 | ST_DIR:
+        return store<Policy>(gpr[a] + gpr[b] + d, gpr[c]);
+    case ST << 4 | ST_IND:
+        return store<Policy>(core.read_word<Policy>(gpr[a] + gpr[b] + d),
+                             gpr[c]);
+    case ST << 4 | ST_PUSH:
+        core.set_gpr(a, gpr[a] + d);
+        return store<Policy>(gpr[a], gpr[c]);
+    case LD << 4 | GPR_CSR:
+        core.set_gpr(a, core.csr[b]);
+        return false;
+    case LD << 4 | GPR_GPR:
+        core.set_gpr(a, gpr[b] + d);
+        return false;
+    case LD << 4 | GPR_MEM:
+        core.set_gpr(a, core.read_word<Policy>(gpr[b] + gpr[c] + d));
+        return false;
+    case LD << 4 | GPR_POP:
+        core.set_gpr(a, core.read_word<Policy>(gpr[b]));
+        core.set_gpr(b, gpr[b] + d);
+        return false;
+    case LD << 4 | CSR_GPR:
+        core.set_csr(a, gpr[b]);
+        return false;
+    case LD << 4 | CSR_CSR:
+        core.set_csr(a, core.csr[b] + d);
+        return false;
+    case LD << 4 | CSR_MEM:
+        core.set_csr(a, core.read_word<Policy>(gpr[b] + gpr[c] + d));
+        return false;
+    case LD << 4 | CSR_POP:
+        core.set_csr(a, core.read_word<Policy>(gpr[b]));
+        core.set_gpr(b, gpr[b] + d);
+        return false;
+    default:
+        core.execute_word<Policy>(instruction.word);
+        return true;
+    }
+}
+
+template unsigned int FastEngine::execute_block<Plain>();
+template unsigned int FastEngine::execute_block<Covered>();
+template unsigned int FastEngine::execute_block<Logged>();
+template unsigned int FastEngine::execute_block<CoveredLogged>();
+template unsigned int FastEngine::execute_block<Counted>();
+template unsigned int FastEngine::execute_block<CoveredCounted>();
+template unsigned int FastEngine::execute_block<LoggedCounted>();
+template unsigned int FastEngine::execute_block<CoveredLoggedCounted>();
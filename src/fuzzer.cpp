@@ -0,0 +1,169 @@
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iomanip>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "emulator.hpp"
+
+using namespace std;
+
+// file descriptors of the AFL fork server pipes
+const int FORKSRV_FD = 198;
+
+unsigned int Fuzzer::read_input() {
+    vector<unsigned char> input;
+    int fd = 0;
+    if (!input_file_name.empty()) {
+        fd = open(input_file_name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cout << "Failed to open file " << input_file_name << endl;
+            exit(-1);
+        }
+    } else {
+        // AFL rewrites the same file behind stdin for every case
+        lseek(0, 0, SEEK_SET);
+    }
+
+    unsigned int capacity = buffer_size - sizeof(unsigned int);
+    input.resize(capacity);
+    unsigned int length = 0;
+    while (length < capacity) {
+        ssize_t done = read(fd, input.data() + length, capacity - length);
+        if (done <= 0) {
+            break;
+        }
+        length += done;
+    }
+    if (fd != 0) {
+        close(fd);
+    }
+
+    // plain stores, so the first write to each page faults as usual
+    Memory *mem = core->mem;
+    mem->write_word(buffer, length);
+    memcpy(mem->host_address(buffer + sizeof(unsigned int)), input.data(),
+           length);
+    mem->modified(buffer, sizeof(unsigned int) + length);
+    return length;
+}
+
+// returns true if the case crashed
+bool Fuzzer::run_case() {
+    core->mem->restore();
+    copy(saved_gpr, saved_gpr + 16, core->gpr);
+    copy(saved_csr, saved_csr + 16, core->csr);
+    core->pending_interrupts = 0;
+    core->faulted = false;
+    edges.previous = 0;
+
+    read_input();
+
+    unsigned long invalid = core->metrics.interrupts[INVALID];
+    unsigned long memory_faults = core->metrics.interrupts[MEMORY_FAULT];
+    core->instruction_limit = core->metrics.instructions + budget;
+    core->resume();
+
+    return core->faulted || core->metrics.interrupts[INVALID] != invalid ||
+           core->metrics.interrupts[MEMORY_FAULT] != memory_faults;
+}
+
+bool Fuzzer::run(Emulator *core) {
+    this->core = core;
+    if (!core->run_to(entry)) {
+        cout << "Stopped before reaching the fuzzing entry point 0x" << hex
+             << setw(8) << setfill('0') << entry << "!" << endl;
+        exit(-1);
+    }
+    copy(core->gpr, core->gpr + 16, saved_gpr);
+    copy(core->csr, core->csr + 16, saved_csr);
+    // from here on current_core is this core, so the SIGSEGV handler also
+    // takes the faults of the input writes made on the host side
+    core->mem->snapshot();
+
+    char *shm_id = getenv("__AFL_SHM_ID");
+    if (shm_id) {
+        void *shared = shmat(atoi(shm_id), nullptr, 0);
+        if (shared == (void *)-1) {
+            cout << "Failed to attach the AFL coverage bitmap!" << endl;
+            exit(-1);
+        }
+        edges.bitmap = (unsigned char *)shared;
+    } else {
+        edges.bitmap = new unsigned char[EDGE_MAP_SIZE]();
+    }
+    core->edges = &edges;
+
+    unsigned int hello = 0;
+    if (write(FORKSRV_FD + 1, &hello, sizeof(hello)) == sizeof(hello)) {
+        serve();
+    }
+
+    unsigned long start = core->metrics.instructions;
+    bool crashed = run_case();
+    unsigned int hit = 0;
+    for (unsigned int i = 0; i < EDGE_MAP_SIZE; i++) {
+        hit += edges.bitmap[i] != 0;
+    }
+    cout << "Fuzz case: " << dec << core->metrics.instructions - start
+         << " instructions, " << hit << " edges, "
+         << (crashed ? "crashed" : core->running ? "budget exhausted"
+                                                 : "halted")
+         << endl;
+    return crashed;
+}
+
+// Persistent mode fork server. The parent only forks, a child runs cases
+// until it crashes or has run iterations of them, then exits.
+void Fuzzer::serve() {
+    pid_t child = -1;
+    bool child_stopped = false;
+    while (true) {
+        unsigned int was_killed;
+        if (read(FORKSRV_FD, &was_killed, sizeof(was_killed)) !=
+            sizeof(was_killed)) {
+            exit(0);
+        }
+        // the fuzzer killed a stopped child on a timeout
+        if (child_stopped && was_killed) {
+            waitpid(child, nullptr, 0);
+            child_stopped = false;
+        }
+
+        if (!child_stopped) {
+            child = fork();
+            if (child < 0) {
+                exit(-1);
+            }
+            if (child == 0) {
+                close(FORKSRV_FD);
+                close(FORKSRV_FD + 1);
+                for (unsigned int i = 0; i < iterations; i++) {
+                    if (i > 0) {
+                        raise(SIGSTOP);
+                    }
+                    if (run_case()) {
+                        abort();
+                    }
+                }
+                _exit(0);
+            }
+        } else {
+            kill(child, SIGCONT);
+            child_stopped = false;
+        }
+
+        int status;
+        if (write(FORKSRV_FD + 1, &child, sizeof(child)) != sizeof(child) ||
+            waitpid(child, &status, WUNTRACED) < 0) {
+            exit(-1);
+        }
+        child_stopped = WIFSTOPPED(status);
+        if (write(FORKSRV_FD + 1, &status, sizeof(status)) !=
+            sizeof(status)) {
+            exit(-1);
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "emulator.hpp"
+
+using namespace std;
+
+// Natives follow the calling convention of test/math.s: arguments are pushed
+// by the caller, the result is returned in %r1 and %r2 is preserved.
+bool native_add(Emulator &emulator) {
+    emulator.hook_return(emulator.hook_argument(0) +
+                         emulator.hook_argument(1));
+    return true;
+}
+
+bool native_sub(Emulator &emulator) {
+    emulator.hook_return(emulator.hook_argument(0) -
+                         emulator.hook_argument(1));
+    return true;
+}
+
+bool native_mul(Emulator &emulator) {
+    emulator.hook_return(emulator.hook_argument(0) *
+                         emulator.hook_argument(1));
+    return true;
+}
+
+// the guest's div traps on a zero divisor, so that call is left to it
+bool native_div(Emulator &emulator) {
+    unsigned int divisor = emulator.hook_argument(1);
+    if (divisor == 0) {
+        return false;
+    }
+    emulator.hook_return(emulator.hook_argument(0) / divisor);
+    return true;
+}
+
+map<string, NativeFunction> natives = {{"mathAdd", native_add},
+                                       {"mathSub", native_sub},
+                                       {"mathMul", native_mul},
+                                       {"mathDiv", native_div}};
+
+map<string, unsigned int> read_symbol_map(string map_file_name) {
+    ifstream file(map_file_name);
+    if (!file) {
+        cout << "Failed to open file " << map_file_name << endl;
+        exit(-1);
+    }
+
+    map<string, unsigned int> symbols;
+    string line;
+    while (getline(file, line)) {
+        stringstream line_stream(line);
+        string name;
+        string value;
+        if (line_stream >> name >> value) {
+            symbols[name] = stoul(value, nullptr, 16);
+        }
+    }
+    file.close();
+    return symbols;
+}
+
+void Hooks::load_symbols(string map_file_name) {
+    symbols = read_symbol_map(map_file_name);
+}
+
+void Hooks::install(Memory *mem, string name) {
+    if (symbols.find(name) == symbols.end()) {
+        cout << "Symbol " << name << " not found in the symbol map!" << endl;
+        exit(-1);
+    }
+    install(mem, name, symbols[name]);
+}
+
+void Hooks::install(Memory *mem, string name, unsigned int address) {
+    if (natives.find(name) == natives.end()) {
+        cout << "No native implementation of " << name << "!" << endl;
+        exit(-1);
+    }
+    for (Hook *hook : hooks) {
+        if (hook->address == address) {
+            cout << "Address 0x" << hex << address << " is already hooked!"
+                 << endl;
+            exit(-1);
+        }
+    }
+
+    Hook *hook = new Hook();
+    hook->name = name;
+    hook->address = address;
+    hook->original = mem->read_word(address);
+    hook->native = natives[name];
+    mem->write_word(address, HOOK << 4 | hooks.size() << 8);
+    hooks.push_back(hook);
+}
+
+void Hooks::report() {
+    cout << "-----------------------------------------------------------------"
+         << "\n";
+    cout << "Native hooks:\n";
+    for (Hook *hook : hooks) {
+        cout << hook->name << " at 0x" << hex << setw(8) << setfill('0')
+             << hook->address << ": " << dec << hook->calls << " calls";
+        if (verify) {
+            cout << ", " << hook->mismatches << " mismatches";
+        }
+        cout << "\n";
+    }
+}
@@ -0,0 +1,245 @@
+#include <fcntl.h>
+#include <iostream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lexer.hpp"
+
+using namespace std;
+
+struct Keyword {
+    string_view name;
+    int token = YYUNDEF;
+    int value = 0;
+};
+
+// mnemonics, directives and register names
+constexpr Keyword KEYWORDS[] = {
+    {"halt", HALT},         {"int", INT},
+    {"iret", IRET},         {"call", CALL},
+    {"ret", RET},           {"jmp", JMP},
+    {"beq", BEQ},           {"bne", BNE},
+    {"bgt", BGT},           {"push", PUSH},
+    {"pop", POP},           {"xchg", XCHG},
+    {"add", ADD},           {"sub", SUB},
+    {"mul", MUL},           {"div", DIV},
+    {"not", NOT},           {"and", AND},
+    {"or", OR},             {"xor", XOR},
+    {"shl", SHL},           {"shr", SHR},
+    {"ld", LD},             {"st", ST},
+    {"csrrd", CSRRD},       {"csrwr", CSRWR},
+    {".word", WORD},        {".skip", SKIP},
+    {".vectors", VECTORS},  {".global", GLOBAL},
+    {".extern", EXTERN},    {".section", SECTION},
+    {".ltorg", LTORG},      {".end", END},
+    {"%status", CSR, 0},    {"%handler", CSR, 1},
+    {"%cause", CSR, 2},     {"%instret", CSR, 3},
+    {"%cycle", CSR, 4},     {"%intcount", CSR, 5},
+    {"%coreid", CSR, 6},    {"%ipi", CSR, 7},
+    {"%r0", GPR, 0},        {"%r1", GPR, 1},
+    {"%r2", GPR, 2},        {"%r3", GPR, 3},
+    {"%r4", GPR, 4},        {"%r5", GPR, 5},
+    {"%r6", GPR, 6},        {"%r7", GPR, 7},
+    {"%r8", GPR, 8},        {"%r9", GPR, 9},
+    {"%r10", GPR, 10},      {"%r11", GPR, 11},
+    {"%r12", GPR, 12},      {"%r13", GPR, 13},
+    {"%r14", GPR, 14},      {"%r15", GPR, 15},
+    {"%sp", GPR, 14},       {"%pc", GPR, 15}};
+
+const unsigned int KEYWORD_SLOT_BITS = 9;
+const unsigned int KEYWORD_SLOTS = 1 << KEYWORD_SLOT_BITS;
+
+// seeded FNV-1a with a final mix, the top bits pick the slot
+constexpr unsigned int keyword_slot(string_view word, unsigned int seed) {
+    unsigned int hash = seed;
+    for (char c : word) {
+        hash = (hash ^ (unsigned char)c) * 16777619U;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3BU;
+    hash ^= hash >> 16;
+    return hash >> (32 - KEYWORD_SLOT_BITS);
+}
+
+// the first seed that gives every keyword a slot of its own
+constexpr unsigned int keyword_seed() {
+    for (unsigned int seed = 2166136261U;; seed += 0x9E3779B9U) {
+        bool used[KEYWORD_SLOTS] = {};
+        bool collision = false;
+        for (const Keyword &keyword : KEYWORDS) {
+            unsigned int slot = keyword_slot(keyword.name, seed);
+            collision |= used[slot];
+            used[slot] = true;
+        }
+        if (!collision) {
+            return seed;
+        }
+    }
+}
+
+constexpr unsigned int KEYWORD_SEED = keyword_seed();
+
+struct KeywordTable {
+    Keyword slots[KEYWORD_SLOTS];
+
+    constexpr KeywordTable() {
+        for (const Keyword &keyword : KEYWORDS) {
+            slots[keyword_slot(keyword.name, KEYWORD_SEED)] = keyword;
+        }
+    }
+
+    // nullptr for words that are not keywords
+    const Keyword *find(string_view word) const {
+        const Keyword &keyword = slots[keyword_slot(word, KEYWORD_SEED)];
+        return keyword.name == word ? &keyword : nullptr;
+    }
+};
+
+constexpr KeywordTable KEYWORD_TABLE;
+
+static bool is_word_char(char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26 ||
+           (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+static int hex_digit(char c) {
+    if ((unsigned char)(c - '0') < 10) {
+        return c - '0';
+    }
+    if ((unsigned char)((c | 0x20) - 'a') < 6) {
+        return (c | 0x20) - 'a' + 10;
+    }
+    return -1;
+}
+
+// decimal or 0x prefixed hexadecimal, wrapping to 32 bits like strtol
+static bool parse_number(string_view word, int &number) {
+    unsigned long value = 0;
+    if (word.size() > 2 && word[0] == '0' && word[1] == 'x') {
+        for (char c : word.substr(2)) {
+            int digit = hex_digit(c);
+            if (digit < 0) {
+                return false;
+            }
+            value = value << 4 | digit;
+        }
+    } else {
+        for (char c : word) {
+            if ((unsigned char)(c - '0') >= 10) {
+                return false;
+            }
+            value = value * 10 + c - '0';
+        }
+    }
+    number = value;
+    return true;
+}
+
+Lexer::Lexer(string file_name, Assembler &assembler) : assembler(assembler) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+        cout << "Failed to open file " << file_name << endl;
+        exit(-1);
+    }
+
+    size = file_stat.st_size;
+    if (size > 0) {
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            cout << "Failed to map file " << file_name << endl;
+            exit(-1);
+        }
+        source = (const char *)mapping;
+        madvise(mapping, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    cursor = source;
+    end = source + size;
+}
+
+Lexer::~Lexer() {
+    if (source) {
+        munmap((void *)source, size);
+    }
+}
+
+// skips blanks and comments, but not line ends
+void Lexer::skip_blanks() {
+    while (cursor < end) {
+        char c = *cursor;
+        if (c == ' ' || c == '\t' || c == '\r') {
+            cursor++;
+        } else if (c == '#') {
+            while (cursor < end && *cursor != '\n') {
+                cursor++;
+            }
+        } else if (c == '/' && cursor + 1 < end && cursor[1] == '*') {
+            cursor += 2;
+            while (cursor < end &&
+                   !(*cursor == '*' && cursor + 1 < end && cursor[1] == '/')) {
+                line += *cursor == '\n';
+                cursor++;
+            }
+            cursor = min(cursor + 2, end);
+        } else {
+            return;
+        }
+    }
+}
+
+int Lexer::next(YYSTYPE *value) {
+    skip_blanks();
+    if (cursor == end) {
+        return YYEOF;
+    }
+
+    char first = *cursor++;
+    switch (first) {
+    case '\n':
+        line++;
+        return ENDL;
+    case ',':
+        return COMMA;
+    case '$':
+        return DOLLAR;
+    case '[':
+        return LBRACKETS;
+    case ']':
+        return RBRACKETS;
+    case '+':
+        return PLUS;
+    }
+    if (first != '.' && first != '%' && !is_word_char(first)) {
+        return YYUNDEF;
+    }
+
+    const char *start = cursor - 1;
+    while (cursor < end && is_word_char(*cursor)) {
+        cursor++;
+    }
+    string_view word(start, cursor - start);
+
+    // anything followed by a colon is a label, even a mnemonic
+    if (first != '.' && first != '%' && cursor < end && *cursor == ':') {
+        cursor++;
+        value->symbol = assembler.intern(word);
+        return LABEL;
+    }
+
+    const Keyword *keyword = KEYWORD_TABLE.find(word);
+    if (keyword) {
+        value->ival = keyword->value;
+        return keyword->token;
+    }
+    if (first == '.' || first == '%') {
+        return YYUNDEF;
+    }
+    if (parse_number(word, value->ival)) {
+        return NUMBER;
+    }
+    value->symbol = assembler.intern(word);
+    return STRING;
+}
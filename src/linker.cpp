@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <fcntl.h>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <regex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "linker.hpp"
 
@@ -9,6 +14,8 @@ using namespace std;
 
 int main(int argc, char *argv[]) {
     string output_name;
+    string map_name;
+    string lines_name;
     vector<string> files;
     map<unsigned int, string> place_options;
     bool hex_appeared = false;
@@ -22,6 +29,16 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
+        if (arg.rfind("-map=", 0) == 0) {
+            map_name = arg.substr(string("-map=").size());
+            continue;
+        }
+
+        if (arg.rfind("-lines=", 0) == 0) {
+            lines_name = arg.substr(string("-lines=").size());
+            continue;
+        }
+
         if (arg == "-o") {
             output_name = string(argv[i + 1]);
             out_appeared = true;
@@ -55,64 +72,198 @@ int main(int argc, char *argv[]) {
     linker.update_symbols();
     linker.relocate();
     linker.output(output_name);
+    if (!map_name.empty()) {
+        linker.output_map(map_name);
+    }
+    if (!lines_name.empty()) {
+        linker.output_lines(lines_name);
+    }
 
     return 0;
 }
 
 void Linker::read_files(vector<string> files) {
     for (string file_name : files) {
-        string line;
-        ifstream file(file_name);
-        vector<Section> file_sections;
+        int fd = open(file_name.c_str(), O_RDONLY);
+        struct stat file_stat;
+        if (fd < 0 || fstat(fd, &file_stat) < 0) {
+            cout << "Failed to open file " << file_name << endl;
+            exit(-1);
+        }
+
+        // binary objects are read in place, anything else is a text object
+        size_t size = file_stat.st_size;
+        void *mapping = MAP_FAILED;
+        if (size >= sizeof(ObjectHeader)) {
+            mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (mapping != MAP_FAILED &&
+            equal(OBJECT_MAGIC, OBJECT_MAGIC + 4, (const char *)mapping)) {
+            read_object((const char *)mapping, size, file_name);
+        } else {
+            read_text_file(file_name);
+        }
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, size);
+        }
+    }
+}
 
-        while (getline(file, line)) {
-            if (line == "Symbol table:") {
-                break;
+void Linker::read_object(const char *data, size_t size, string file_name) {
+    size_t position = 0;
+    // the next bytes of the object, which must all be in the file
+    auto take = [&](size_t bytes) {
+        if (bytes > size - position) {
+            cout << "Object file " << file_name << " is truncated!" << endl;
+            exit(-1);
+        }
+        const char *part = data + position;
+        position += bytes;
+        return part;
+    };
+
+    const ObjectHeader &header =
+        *(const ObjectHeader *)take(sizeof(ObjectHeader));
+    if (header.version != OBJECT_VERSION) {
+        cout << "Object file " << file_name << " has version "
+             << header.version << ", expected " << OBJECT_VERSION << "!"
+             << endl;
+        exit(-1);
+    }
+
+    const char *strings = take(object_align(header.string_table_size));
+    if (header.string_table_size == 0 ||
+        strings[header.string_table_size - 1] != '\0') {
+        cout << "Object file " << file_name << " has a bad string table!"
+             << endl;
+        exit(-1);
+    }
+    auto name = [&](uint32_t offset) {
+        if (offset >= header.string_table_size) {
+            cout << "Object file " << file_name << " has a bad name!" << endl;
+            exit(-1);
+        }
+        return string(strings + offset);
+    };
+
+    const ObjectSymbol *symbols = (const ObjectSymbol *)take(
+        (size_t)header.symbol_count * sizeof(ObjectSymbol));
+    vector<Section> file_sections(header.section_count);
+    for (Section &section : file_sections) {
+        const ObjectSection &record =
+            *(const ObjectSection *)take(sizeof(ObjectSection));
+        section.name = name(record.name);
+        section.length = record.length;
+        const unsigned char *content =
+            (const unsigned char *)take(object_align(record.length));
+        section.content.assign(content, content + record.length);
+
+        const ObjectRelocation *relocations = (const ObjectRelocation *)take(
+            (size_t)record.relocation_count * sizeof(ObjectRelocation));
+        section.relocations.resize(record.relocation_count);
+        for (uint32_t i = 0; i < record.relocation_count; i++) {
+            if (relocations[i].symbol >= header.symbol_count) {
+                cout << "Object file " << file_name
+                     << " has a relocation without a symbol!" << endl;
+                exit(-1);
             }
+            section.relocations[i].offset = relocations[i].offset;
+            section.relocations[i].addend = relocations[i].addend;
+            section.relocations[i].symbol =
+                name(symbols[relocations[i].symbol].name);
+        }
+    }
+
+    // only the global symbols take part in linking
+    for (uint32_t i = 0; i < header.symbol_count; i++) {
+        if (!(symbols[i].flags & OBJECT_GLOBAL)) {
+            continue;
+        }
+        Symbol symbol;
+        symbol.name = name(symbols[i].name);
+        symbol.value = symbols[i].value;
+        symbol.is_defined = symbols[i].flags & OBJECT_DEFINED;
+        symbol.section_name = symbols[i].section == OBJECT_NONE
+                                  ? "UND"
+                                  : name(symbols[i].section);
+        symbol.file_name = file_name;
+        add_symbol(symbol);
+    }
+
+    if (header.source_file != OBJECT_NONE) {
+        source_files[file_name] = name(header.source_file);
+        vector<LineEntry> &lines = line_tables[file_name];
+        const ObjectLine *entries = (const ObjectLine *)take(
+            (size_t)header.line_count * sizeof(ObjectLine));
+        lines.resize(header.line_count);
+        for (uint32_t i = 0; i < header.line_count; i++) {
+            lines[i].section_name = name(entries[i].section);
+            lines[i].offset = entries[i].offset;
+            lines[i].size = entries[i].size;
+            lines[i].line = entries[i].line;
+        }
+    }
 
-            Section section;
-            section.name = line;
-            string length_text;
-            string bytes_text;
+    sections[file_name] = move(file_sections);
+}
 
-            getline(file, length_text);
-            section.length = stoul(length_text);
+void Linker::read_text_file(string file_name) {
+    string line;
+    ifstream file(file_name);
+    vector<Section> file_sections;
 
-            getline(file, bytes_text);
-            stringstream bytes(bytes_text);
-            unsigned int byte;
-            while (bytes >> hex >> byte) {
-                section.content.push_back(byte);
-            }
+    while (getline(file, line)) {
+        if (line == "Symbol table:") {
+            break;
+        }
 
-            string relocation_line;
-            getline(file, relocation_line);
-            while (relocation_line != "---") {
-                Relocation relocation;
-                stringstream rel_ss(relocation_line);
-                rel_ss >> relocation.offset >> relocation.addend >>
-                    relocation.symbol;
-                section.relocations.push_back(relocation);
-                getline(file, relocation_line);
-            }
-            file_sections.push_back(section);
+        Section section;
+        section.name = line;
+        string length_text;
+        string bytes_text;
+
+        getline(file, length_text);
+        section.length = stoul(length_text);
+
+        getline(file, bytes_text);
+        stringstream bytes(bytes_text);
+        unsigned int byte;
+        while (bytes >> hex >> byte) {
+            section.content.push_back(byte);
         }
 
-        while (getline(file, line)) {
-            if (line == "") {
-                continue;
-            }
-            Symbol symbol;
-            stringstream sym_ss(line);
-            sym_ss >> symbol.name >> symbol.value >> symbol.is_defined >>
-                symbol.section_name;
-            symbol.file_name = file_name;
-            add_symbol(symbol);
+        string relocation_line;
+        getline(file, relocation_line);
+        while (relocation_line != "---") {
+            Relocation relocation;
+            stringstream rel_ss(relocation_line);
+            rel_ss >> relocation.offset >> relocation.addend >>
+                relocation.symbol;
+            section.relocations.push_back(relocation);
+            getline(file, relocation_line);
         }
+        file_sections.push_back(section);
+    }
 
-        sections[file_name] = file_sections;
-        file.close();
+    while (getline(file, line)) {
+        if (line == "") {
+            continue;
+        }
+        if (line == "Line table:") {
+            read_line_table(file, file_name);
+            break;
+        }
+        Symbol symbol;
+        stringstream sym_ss(line);
+        sym_ss >> symbol.name >> symbol.value >> symbol.is_defined >>
+            symbol.section_name;
+        symbol.file_name = file_name;
+        add_symbol(symbol);
     }
+
+    sections[file_name] = file_sections;
+    file.close();
 }
 
 void Linker::add_symbol(Symbol symbol) {
@@ -300,4 +451,52 @@ void Linker::write_word(string section, unsigned int location,
         content[location] = byte;
         location++;
     }
-}
\ No newline at end of file
+}
+void Linker::output_map(string map_file_name) {
+    map<string, unsigned int> sorted_symbols;
+    for (auto &entry : symbol_table) {
+        sorted_symbols[entry.first] = entry.second.value;
+    }
+
+    ofstream map_file(map_file_name);
+    for (auto &entry : sorted_symbols) {
+        map_file << entry.first << " " << hex << setw(8) << setfill('0')
+                 << entry.second << "\n";
+    }
+    map_file.close();
+}
+
+void Linker::read_line_table(ifstream &file, string file_name) {
+    string line;
+    getline(file, source_files[file_name]);
+    vector<LineEntry> &entries = line_tables[file_name];
+    while (getline(file, line)) {
+        LineEntry entry;
+        stringstream entry_ss(line);
+        if (entry_ss >> entry.section_name >> entry.offset >> entry.size >>
+            entry.line) {
+            entries.push_back(entry);
+        }
+    }
+}
+
+void Linker::output_lines(string lines_file_name) {
+    map<unsigned int, string> sorted_lines;
+    for (auto &table : line_tables) {
+        string &source_file = source_files[table.first];
+        for (auto &entry : table.second) {
+            unsigned int address =
+                get_section(table.first, entry.section_name)->location +
+                entry.offset;
+            sorted_lines[address] = to_string(entry.size) + " " +
+                                    to_string(entry.line) + " " + source_file;
+        }
+    }
+
+    ofstream lines_file(lines_file_name);
+    for (auto &entry : sorted_lines) {
+        lines_file << hex << setw(8) << setfill('0') << entry.first << " "
+                   << entry.second << "\n";
+    }
+    lines_file.close();
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memory.hpp"
+
+using namespace std;
+
+// one extra page so a word starting at the last addresses stays in bounds
+const unsigned long MEMORY_SIZE = (1UL << 32) + 0x1000;
+
+Memory::Memory() {
+    void *mapping = mmap(nullptr, MEMORY_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        cout << "Failed to reserve guest memory!" << endl;
+        exit(-1);
+    }
+    base = (unsigned char *)mapping;
+    page_size = sysconf(_SC_PAGESIZE);
+    loaded_pages.resize((1UL << 32) / page_size);
+}
+
+Memory::~Memory() { munmap(base, MEMORY_SIZE); }
+
+Image parse_image(string &text) {
+    Image image;
+    stringstream text_stream(text);
+    string line;
+    while (getline(text_stream, line)) {
+        stringstream line_stream(line);
+        string address_string;
+        if (!(line_stream >> address_string)) {
+            continue;
+        }
+        address_string.pop_back();
+        unsigned int address = stoul(address_string, nullptr, 16);
+
+        if (image.segments.empty() ||
+            image.segments.back().first +
+                    image.segments.back().second.size() !=
+                address) {
+            image.segments.push_back({address, {}});
+        }
+        unsigned int byte;
+        while (line_stream >> hex >> byte) {
+            image.segments.back().second.push_back(byte);
+        }
+    }
+    return image;
+}
+
+void Memory::load_memory(string input_file_name) {
+    ifstream file(input_file_name);
+    if (!file) {
+        cout << "Failed to open file " << input_file_name << endl;
+        exit(-1);
+    }
+    stringstream text;
+    text << file.rdbuf();
+    file.close();
+
+    string contents = text.str();
+    Image image = parse_image(contents);
+    load_image(image);
+}
+
+void Memory::load_image(Image &image) {
+    for (auto &segment : image.segments) {
+        unsigned long end = segment.first + segment.second.size();
+        unsigned long length = min(end, 1UL << 32) - segment.first;
+        memcpy(base + segment.first, segment.second.data(), length);
+        for (unsigned long page = segment.first / page_size;
+             page * page_size < segment.first + length; page++) {
+            loaded_pages[page] = true;
+        }
+    }
+}
+
+void Memory::protect(unsigned long start, unsigned long size) {
+    unsigned long end = min(start + size, 1UL << 32);
+    start = start / page_size * page_size;
+    end = (end + page_size - 1) / page_size * page_size;
+    if (start >= end) {
+        return;
+    }
+
+    if (mprotect(base + start, end - start, PROT_NONE) < 0) {
+        cout << "Failed to protect guest memory!" << endl;
+        exit(-1);
+    }
+    guards.push_back({start, end});
+    sort(guards.begin(), guards.end());
+    // overlapping and adjacent guards are merged for the lookup
+    vector<pair<unsigned long, unsigned long>> merged;
+    for (auto &guard : guards) {
+        if (!merged.empty() && guard.first <= merged.back().second) {
+            merged.back().second = max(merged.back().second, guard.second);
+        } else {
+            merged.push_back(guard);
+        }
+    }
+    guards = merged;
+}
+
+void Memory::protect_unmapped(
+    vector<pair<unsigned long, unsigned long>> &mapped) {
+    vector<bool> accessible = loaded_pages;
+    for (auto &region : mapped) {
+        unsigned long end = min(region.first + region.second, 1UL << 32);
+        for (unsigned long page = region.first / page_size;
+             page * page_size < end; page++) {
+            accessible[page] = true;
+        }
+    }
+
+    unsigned long pages = accessible.size();
+    for (unsigned long page = 0; page < pages;) {
+        unsigned long first = page;
+        while (page < pages && !accessible[page]) {
+            page++;
+        }
+        if (page > first) {
+            protect(first * page_size, (page - first) * page_size);
+        }
+        while (page < pages && accessible[page]) {
+            page++;
+        }
+    }
+}
+
+// Write protects guest memory outside the guards. Writes then fault into
+// write_fault, so restore only has to copy back the pages that changed.
+void Memory::snapshot() {
+    if (!shadow) {
+        void *mapping =
+            mmap(nullptr, MEMORY_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapping == MAP_FAILED) {
+            cout << "Failed to reserve snapshot memory!" << endl;
+            exit(-1);
+        }
+        shadow = (unsigned char *)mapping;
+        saved_pages.resize((1UL << 32) / page_size);
+        dirty_pages = new unsigned int[saved_pages.size()];
+    }
+
+    unsigned long start = 0;
+    for (auto &guard : guards) {
+        if (guard.first > start) {
+            mprotect(base + start, guard.first - start, PROT_READ);
+        }
+        start = max(start, guard.second);
+    }
+    if (start < 1UL << 32) {
+        mprotect(base + start, (1UL << 32) - start, PROT_READ);
+    }
+}
+
+// called from the SIGSEGV handler, so it only touches preallocated state
+bool Memory::write_fault(void *host_address) {
+    if (!shadow || !contains(host_address)) {
+        return false;
+    }
+    unsigned long page = guest_address(host_address) / page_size;
+    if (is_guarded(page * page_size)) {
+        return false;
+    }
+
+    unsigned long offset = page * page_size;
+    if (!saved_pages[page]) {
+        memcpy(shadow + offset, base + offset, page_size);
+        saved_pages[page] = true;
+    }
+    mprotect(base + offset, page_size, PROT_READ | PROT_WRITE);
+    dirty_pages[dirty_count++] = page;
+    return true;
+}
+
+void Memory::restore() {
+    for (unsigned long i = 0; i < dirty_count; i++) {
+        unsigned long offset = (unsigned long)dirty_pages[i] * page_size;
+        // only lines that really changed can invalidate decoded code
+        unsigned long line_size = 1UL << CODE_LINE_SHIFT;
+        for (unsigned long line = offset; line < offset + page_size;
+             line += line_size) {
+            if (memcmp(base + line, shadow + line, line_size)) {
+                memcpy(base + line, shadow + line, line_size);
+                modified(line, line_size);
+            }
+        }
+        mprotect(base + offset, page_size, PROT_READ);
+    }
+    dirty_count = 0;
+}
@@ -0,0 +1,212 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "emulator.hpp"
+
+using namespace std;
+
+MetricsReporter::MetricsReporter(vector<Emulator *> *cores, Bus *bus)
+    : cores(cores), bus(bus) {}
+
+void MetricsReporter::start() {
+    last_instructions.assign(cores->size(), 0);
+    mips.assign(cores->size(), 0);
+    if (pipe(stop_pipe) < 0) {
+        cout << "Failed to start the metrics reporter!" << endl;
+        exit(-1);
+    }
+
+    if (!socket_name.empty()) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socket_name.size() >= sizeof(address.sun_path)) {
+            cout << "Metrics socket path " << socket_name << " is too long!"
+                 << endl;
+            exit(-1);
+        }
+        socket_name.copy(address.sun_path, socket_name.size());
+        unlink(socket_name.c_str());
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 ||
+            bind(listen_fd, (sockaddr *)&address, sizeof(address)) < 0 ||
+            listen(listen_fd, 4) < 0) {
+            cout << "Failed to open metrics socket " << socket_name << endl;
+            exit(-1);
+        }
+    }
+
+    reporter = thread(&MetricsReporter::run, this);
+}
+
+void MetricsReporter::stop() {
+    char byte = 0;
+    if (write(stop_pipe[1], &byte, 1) < 0) {
+        cout << "Failed to stop the metrics reporter!" << endl;
+        exit(-1);
+    }
+    reporter.join();
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_name.c_str());
+    }
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+}
+
+void MetricsReporter::run() {
+    auto last_update = chrono::steady_clock::now();
+    auto next_update = last_update + chrono::milliseconds(interval);
+
+    while (true) {
+        auto now = chrono::steady_clock::now();
+        int timeout = max(0L, (long)chrono::duration_cast<chrono::milliseconds>(
+                                     next_update - now)
+                                     .count());
+        pollfd fds[] = {{stop_pipe[0], POLLIN, 0}, {listen_fd, POLLIN, 0}};
+        poll(fds, listen_fd >= 0 ? 2 : 1, timeout);
+
+        now = chrono::steady_clock::now();
+        if (now >= next_update || (fds[0].revents & POLLIN)) {
+            update(chrono::duration<double>(now - last_update).count());
+            last_update = now;
+            next_update = now + chrono::milliseconds(interval);
+            if (!file_name.empty()) {
+                write_file();
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            return;
+        }
+        if (listen_fd >= 0 && (fds[1].revents & POLLIN)) {
+            int client_fd = accept(listen_fd, nullptr, nullptr);
+            if (client_fd >= 0) {
+                serve(client_fd);
+            }
+        }
+    }
+}
+
+void MetricsReporter::update(double seconds) {
+    for (size_t i = 0; i < cores->size(); i++) {
+        unsigned long instructions =
+            read_counter((*cores)[i]->metrics.instructions);
+        if (seconds > 0) {
+            mips[i] = (instructions - last_instructions[i]) / seconds / 1e6;
+        }
+        last_instructions[i] = instructions;
+    }
+}
+
+string MetricsReporter::render() {
+    const char *causes[] = {"device_tick", "invalid", "timer",
+                            "terminal",    "software", "interprocessor",
+                            "block",       "dma",      "memory_fault"};
+    stringstream out;
+
+    out << "# HELP emulator_instructions_retired_total Instructions retired."
+        << "\n# TYPE emulator_instructions_retired_total counter\n";
+    for (size_t i = 0; i < cores->size(); i++) {
+        out << "emulator_instructions_retired_total{core=\"" << i << "\"} "
+            << read_counter((*cores)[i]->metrics.instructions) << "\n";
+    }
+
+    out << "# HELP emulator_mips Millions of instructions retired per second."
+        << "\n# TYPE emulator_mips gauge\n";
+    for (size_t i = 0; i < cores->size(); i++) {
+        out << "emulator_mips{core=\"" << i << "\"} " << mips[i] << "\n";
+    }
+
+    out << "# HELP emulator_interrupts_total Interrupts taken, by cause."
+        << "\n# TYPE emulator_interrupts_total counter\n";
+    for (size_t i = 0; i < cores->size(); i++) {
+        for (int cause = INVALID; cause <= MEMORY_FAULT; cause++) {
+            out << "emulator_interrupts_total{core=\"" << i << "\",cause=\""
+                << causes[cause] << "\"} "
+                << read_counter((*cores)[i]->metrics.interrupts[cause])
+                << "\n";
+        }
+    }
+
+    const char *block_counters[][2] = {
+        {"hits", "Fast engine blocks found in the cache."},
+        {"misses", "Fast engine blocks decoded."},
+        {"flushes", "Fast engine block cache flushes."}};
+    for (int counter = 0; counter < 3; counter++) {
+        string name =
+            string("emulator_block_cache_") + block_counters[counter][0];
+        out << "# HELP " << name << "_total " << block_counters[counter][1]
+            << "\n# TYPE " << name << "_total counter\n";
+        for (size_t i = 0; i < cores->size(); i++) {
+            CoreMetrics &metrics = (*cores)[i]->metrics;
+            unsigned long *values[] = {&metrics.block_hits,
+                                       &metrics.block_misses,
+                                       &metrics.block_flushes};
+            out << name << "_total{core=\"" << i << "\"} "
+                << read_counter(*values[counter]) << "\n";
+        }
+    }
+
+    out << "# HELP emulator_mmio_accesses_total Accesses to the memory-mapped"
+        << " register window, by device.\n"
+        << "# TYPE emulator_mmio_accesses_total counter\n";
+    unsigned long device_accesses = 0;
+    for (Region &region : bus->mapped_regions()) {
+        unsigned long accesses = read_counter(region.accesses);
+        device_accesses += accesses;
+        out << "emulator_mmio_accesses_total{device=\"" << region.name
+            << "\"} " << accesses << "\n";
+    }
+    out << "emulator_mmio_accesses_total{device=\"unmapped\"} "
+        << read_counter(bus->accesses) - device_accesses << "\n";
+
+    return out.str();
+}
+
+void MetricsReporter::write_file() {
+    // renamed into place so readers never see a partial file
+    string temporary_name = file_name + ".tmp";
+    ofstream file(temporary_name);
+    file << render();
+    file.close();
+    if (!file || rename(temporary_name.c_str(), file_name.c_str()) < 0) {
+        cout << "Failed to write metrics to " << file_name << endl;
+    }
+}
+
+void MetricsReporter::serve(int client_fd) {
+    // answer as a minimal HTTP server so curl --unix-socket works, the
+    // request itself is not needed
+    char request[1024];
+    pollfd fd = {client_fd, POLLIN, 0};
+    if (poll(&fd, 1, 100) > 0) {
+        if (read(client_fd, request, sizeof(request)) < 0) {
+            close(client_fd);
+            return;
+        }
+    }
+
+    string body = render();
+    string response = "HTTP/1.0 200 OK\r\n"
+                      "Content-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: " +
+                      to_string(body.size()) + "\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t done = send(client_fd, response.data() + sent,
+                            response.size() - sent, MSG_NOSIGNAL);
+        if (done <= 0) {
+            break;
+        }
+        sent += done;
+    }
+    close(client_fd);
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+
+#include "assembler.hpp"
+
+using namespace std;
+
+const char *PEEPHOLE_RULE_NAMES[PEEPHOLE_RULES] = {
+    "push/pop pairs", "push/pop moves", "repeated loads", "self moves",
+    "branches to next"};
+
+// a literal or a symbol's address that a register holds
+struct KnownValue {
+    bool known = false;
+    int adressing_mode;
+    int value;
+};
+
+static KnownValue loaded_value(const Operand &op) {
+    KnownValue loaded;
+    loaded.known = true;
+    loaded.adressing_mode = op.adressing_mode;
+    loaded.value = op.adressing_mode == IMMED ? op.literal : op.symbol;
+    return loaded;
+}
+
+// registers an instruction writes, one bit each
+static unsigned int written_registers(const Statement &statement) {
+    const Instruction &instruction = statement.instruction;
+    switch (statement.kind) {
+    case PUSH_INSTRUCTION:
+        return 1 << 14;
+    case POP_INSTRUCTION:
+        return 1 << instruction.gpr1 | 1 << 14;
+    case XCHG_INSTRUCTION:
+        return 1 << instruction.gpr1 | 1 << instruction.gpr2;
+    case ADD_INSTRUCTION:
+    case SUB_INSTRUCTION:
+    case MUL_INSTRUCTION:
+    case DIV_INSTRUCTION:
+    case AND_INSTRUCTION:
+    case OR_INSTRUCTION:
+    case XOR_INSTRUCTION:
+    case SHL_INSTRUCTION:
+    case SHR_INSTRUCTION:
+        return 1 << instruction.gpr2;
+    case NOT_INSTRUCTION:
+    case LD_INSTRUCTION:
+    case CSRRD_INSTRUCTION:
+        return 1 << instruction.gpr1;
+    default:
+        return 0;
+    }
+}
+
+// after these nothing is known about the registers, the code that follows
+// is either not reached from them or runs after a call or a trap
+static bool ends_run(StatementKind kind) {
+    switch (kind) {
+    case HALT_INSTRUCTION:
+    case INT_INSTRUCTION:
+    case IRET_INSTRUCTION:
+    case RET_INSTRUCTION:
+    case CALL_INSTRUCTION:
+    case JMP_INSTRUCTION:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// true if only line ends and labels, one of them the target, follow
+static bool branches_to_next(deque<Statement> &program, size_t index) {
+    const Operand &op = program[index].instruction.operand;
+    if (op.adressing_mode != SYM_DIR) {
+        return false;
+    }
+    for (size_t i = index + 1; i < program.size(); i++) {
+        if (program[i].kind == LABEL_STATEMENT) {
+            if ((unsigned int)program[i].number == op.symbol) {
+                return true;
+            }
+        } else if (program[i].kind != LINE_END) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Applies the rewrites listed with PeepholeRule in one walk over the
+// program, tracking the constants loaded into registers since the last
+// label. Line ends stay, so removed code leaves its line empty.
+void Assembler::peephole() {
+    vector<bool> removed(program.size());
+    KnownValue known[16];
+    // instructions kept since the last label, the last one right before
+    // the instruction at hand
+    vector<size_t> run;
+
+    for (size_t i = 0; i < program.size(); i++) {
+        Statement &statement = program[i];
+        Instruction &instruction = statement.instruction;
+        const Operand &op = instruction.operand;
+        if (statement.kind == LINE_END) {
+            continue;
+        }
+        if (statement.kind < HALT_INSTRUCTION) {
+            fill(known, known + 16, KnownValue());
+            run.clear();
+            continue;
+        }
+
+        PeepholeRule rule = PEEPHOLE_RULES;
+        int pushed = -1;
+        if (!run.empty() && program[run.back()].kind == PUSH_INSTRUCTION) {
+            pushed = program[run.back()].instruction.gpr1;
+        }
+        switch (statement.kind) {
+        case JMP_INSTRUCTION:
+        case BEQ_INSTRUCTION:
+        case BNE_INSTRUCTION:
+        case BGT_INSTRUCTION:
+            if (branches_to_next(program, i)) {
+                rule = BRANCH_TO_NEXT;
+            }
+            break;
+        case POP_INSTRUCTION:
+            if (pushed == instruction.gpr1) {
+                rule = PUSH_POP;
+            } else if (pushed >= 0 && pushed < sp && instruction.gpr1 < sp) {
+                rule = PUSH_POP_MOVE;
+            }
+            break;
+        case LD_INSTRUCTION:
+            if (op.adressing_mode == REGDIR && op.reg == instruction.gpr1) {
+                rule = SELF_MOVE;
+            } else if (op.adressing_mode == IMMED ||
+                       op.adressing_mode == SYMBOL) {
+                KnownValue &held = known[instruction.gpr1];
+                KnownValue loaded = loaded_value(op);
+                if (held.known && held.value == loaded.value &&
+                    held.adressing_mode == loaded.adressing_mode) {
+                    rule = REPEATED_LOAD;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+
+        if (rule != PEEPHOLE_RULES) {
+            rewrites[rule]++;
+        }
+        if (rule == PUSH_POP || rule == PUSH_POP_MOVE) {
+            removed[run.back()] = true;
+            run.pop_back();
+        }
+        if (rule == PUSH_POP_MOVE) {
+            statement.kind = LD_INSTRUCTION;
+            instruction.operand.adressing_mode = REGDIR;
+            instruction.operand.reg = pushed;
+        } else if (rule != PEEPHOLE_RULES) {
+            removed[i] = true;
+            continue;
+        }
+
+        unsigned int written = written_registers(statement);
+        if (ends_run(statement.kind) || (written & 1 << pc)) {
+            fill(known, known + 16, KnownValue());
+            run.clear();
+            continue;
+        }
+        for (int reg = 0; reg < 16; reg++) {
+            if (written & 1 << reg) {
+                known[reg] = KnownValue();
+            }
+        }
+        if (statement.kind == LD_INSTRUCTION && instruction.gpr1 != 0) {
+            if (op.adressing_mode == IMMED || op.adressing_mode == SYMBOL) {
+                known[instruction.gpr1] = loaded_value(op);
+            } else if (op.adressing_mode == REGDIR) {
+                known[instruction.gpr1] = known[op.reg];
+            }
+        }
+        run.push_back(i);
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < program.size(); i++) {
+        if (!removed[i]) {
+            if (kept != i) {
+                program[kept] = move(program[i]);
+            }
+            kept++;
+        }
+    }
+    program.erase(program.begin() + kept, program.end());
+}
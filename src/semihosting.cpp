@@ -0,0 +1,103 @@
+#include <cstring>
+
+#include "semihosting.hpp"
+
+using namespace std;
+
+const unsigned int ERROR = 0xFFFFFFFF;
+
+FILE *Semihosting::get_file(unsigned int handle) {
+    lock_guard<mutex> lock(files_mutex);
+    if (handle >= files.size()) {
+        return nullptr;
+    }
+    return files[handle];
+}
+
+unsigned int Semihosting::call(Memory *mem, unsigned int service,
+                               unsigned int arguments) {
+    if (!mem->is_mapped(arguments, 3 * sizeof(unsigned int))) {
+        return ERROR;
+    }
+    unsigned int first = mem->read_word(arguments);
+    unsigned int second = mem->read_word(arguments + 4);
+    unsigned int length = mem->read_word(arguments + 8);
+
+    switch (service) {
+    case SYS_COPY:
+        if (!mem->is_mapped(first, length) || !mem->is_mapped(second, length)) {
+            return ERROR;
+        }
+        memmove(mem->host_address(first), mem->host_address(second), length);
+        mem->modified(first, length);
+        return 0;
+    case SYS_FILL:
+        if (!mem->is_mapped(first, length)) {
+            return ERROR;
+        }
+        memset(mem->host_address(first), second & 0xFF, length);
+        mem->modified(first, length);
+        return 0;
+    case SYS_COMPARE: {
+        if (!mem->is_mapped(first, length) || !mem->is_mapped(second, length)) {
+            return ERROR;
+        }
+        int result =
+            memcmp(mem->host_address(first), mem->host_address(second), length);
+        return result < 0 ? -1 : result > 0;
+    }
+    case SYS_STRLEN: {
+        unsigned int limit = mem->mapped_length(first);
+        void *end = memchr(mem->host_address(first), '\0', limit);
+        if (!end) {
+            return ERROR;
+        }
+        return (unsigned char *)end - mem->host_address(first);
+    }
+    case SYS_OPEN: {
+        unsigned int limit = mem->mapped_length(first);
+        const char *path = (const char *)mem->host_address(first);
+        const char *modes[] = {"rb", "wb", "ab"};
+        if (!memchr(path, '\0', limit) || second > 2) {
+            return ERROR;
+        }
+        FILE *file = fopen(path, modes[second]);
+        if (!file) {
+            return ERROR;
+        }
+        lock_guard<mutex> lock(files_mutex);
+        files.push_back(file);
+        return files.size() - 1;
+    }
+    case SYS_READ: {
+        FILE *file = get_file(first);
+        if (!file || !mem->is_mapped(second, length)) {
+            return ERROR;
+        }
+        unsigned int read = fread(mem->host_address(second), 1, length, file);
+        mem->modified(second, read);
+        return read;
+    }
+    case SYS_WRITE: {
+        FILE *file = get_file(first);
+        if (!file || !mem->is_mapped(second, length)) {
+            return ERROR;
+        }
+        unsigned int written =
+            fwrite(mem->host_address(second), 1, length, file);
+        fflush(file);
+        return written;
+    }
+    case SYS_CLOSE: {
+        lock_guard<mutex> lock(files_mutex);
+        if (first <= 2 || first >= files.size() || !files[first]) {
+            return ERROR;
+        }
+        fclose(files[first]);
+        files[first] = nullptr;
+        return 0;
+    }
+    default:
+        return ERROR;
+    }
+}
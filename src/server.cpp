@@ -0,0 +1,235 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "emulator.hpp"
+#include "server.hpp"
+
+using namespace std;
+
+const unsigned int MAX_REQUEST_SIZE = 1 << 16;
+
+static unsigned long hash_text(string &text) {
+    // 64-bit FNV-1a
+    unsigned long hash = 0xCBF29CE484222325UL;
+    for (unsigned char byte : text) {
+        hash = (hash ^ byte) * 0x100000001B3UL;
+    }
+    return hash;
+}
+
+Server::Server(string socket_name, unsigned int threads,
+               unsigned long instruction_limit)
+    : socket_name(socket_name), threads(threads),
+      instruction_limit(instruction_limit) {}
+
+void Server::run() {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_name.size() >= sizeof(address.sun_path)) {
+        cout << "Server socket path " << socket_name << " is too long!"
+             << endl;
+        exit(-1);
+    }
+    socket_name.copy(address.sun_path, socket_name.size());
+    unlink(socket_name.c_str());
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, (sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listen_fd, 64) < 0) {
+        cout << "Failed to open server socket " << socket_name << endl;
+        exit(-1);
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        thread(&Server::worker, this).detach();
+    }
+    cout << "Listening on " << socket_name << " with " << threads
+         << " workers" << endl;
+
+    while (true) {
+        int client_fd = accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            continue;
+        }
+        lock_guard<mutex> lock(clients_mutex);
+        clients.push(client_fd);
+        clients_ready.notify_one();
+    }
+}
+
+void Server::worker() {
+    while (true) {
+        unique_lock<mutex> lock(clients_mutex);
+        clients_ready.wait(lock, [this] { return !clients.empty(); });
+        int client_fd = clients.front();
+        clients.pop();
+        lock.unlock();
+
+        handle(client_fd);
+    }
+}
+
+void Server::handle(int client_fd) {
+    // read up to the "run" line, or until the client shuts down its side
+    string request;
+    char buffer[4096];
+    while (request.size() < MAX_REQUEST_SIZE &&
+           request.find("run\n") == string::npos) {
+        ssize_t done = read(client_fd, buffer, sizeof(buffer));
+        if (done <= 0) {
+            break;
+        }
+        request.append(buffer, done);
+    }
+
+    string response = execute(request);
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t done = send(client_fd, response.data() + sent,
+                            response.size() - sent, MSG_NOSIGNAL);
+        if (done <= 0) {
+            break;
+        }
+        sent += done;
+    }
+    close(client_fd);
+}
+
+string Server::execute(string &request) {
+    string image_name;
+    unsigned long hash = 0;
+    bool hash_given = false;
+    unsigned int start_address = 0x40000000;
+    unsigned long instruction_limit = this->instruction_limit;
+    vector<pair<unsigned int, unsigned int>> registers;
+    bool fast = false;
+
+    stringstream request_stream(request);
+    string line;
+    try {
+        while (getline(request_stream, line)) {
+            stringstream line_stream(line);
+            string key, value;
+            if (!(line_stream >> key) || key == "run") {
+                continue;
+            }
+            if (key == "fast") {
+                fast = true;
+                continue;
+            }
+            if (!(line_stream >> value)) {
+                return "error Missing value for " + key + "\n";
+            }
+
+            if (key == "image") {
+                image_name = value;
+            } else if (key == "hash") {
+                hash = stoul(value, nullptr, 16);
+                hash_given = true;
+            } else if (key == "start") {
+                start_address = stoul(value, nullptr, 0);
+            } else if (key == "limit") {
+                instruction_limit = stoul(value, nullptr, 0);
+            } else if (key == "reg") {
+                unsigned int index = stoul(value);
+                if (!(line_stream >> value) || index == 0 || index > 14) {
+                    return "error Expected reg <1-14> <value>\n";
+                }
+                registers.push_back(
+                    {index, (unsigned int)stoul(value, nullptr, 0)});
+            } else {
+                return "error Unknown key " + key + "\n";
+            }
+        }
+    } catch (exception &) {
+        return "error Malformed line: " + line + "\n";
+    }
+
+    bool cached = true;
+    shared_ptr<Image> image;
+    if (!image_name.empty()) {
+        ifstream file(image_name);
+        if (!file) {
+            return "error Failed to open file " + image_name + "\n";
+        }
+        stringstream text;
+        text << file.rdbuf();
+        string contents = text.str();
+        hash = hash_text(contents);
+
+        unique_lock<mutex> lock(images_mutex);
+        auto found = images.find(hash);
+        if (found != images.end()) {
+            image = found->second;
+        } else {
+            // parsed without the lock, a racing parse of the same file
+            // just replaces an identical image
+            lock.unlock();
+            cached = false;
+            try {
+                image = make_shared<Image>(parse_image(contents));
+            } catch (exception &) {
+                return "error Malformed image " + image_name + "\n";
+            }
+            lock.lock();
+            images[hash] = image;
+        }
+    } else if (hash_given) {
+        lock_guard<mutex> lock(images_mutex);
+        auto found = images.find(hash);
+        if (found == images.end()) {
+            return "error Unknown image hash\n";
+        }
+        image = found->second;
+    } else {
+        return "error Expected image or hash\n";
+    }
+
+    Memory memory;
+    memory.load_image(*image);
+    if (fast) {
+        memory.track_code();
+    }
+    Bus bus(&memory);
+    vector<Emulator *> cores;
+    Emulator core(&memory, &bus, &cores, 0);
+    cores.push_back(&core);
+    FastEngine engine(core, &memory);
+    if (fast) {
+        core.engine = &engine;
+    }
+    core.start_address = start_address;
+    core.instruction_limit = instruction_limit;
+    for (auto &reg : registers) {
+        core.set_gpr(reg.first, reg.second);
+    }
+
+    auto start = chrono::steady_clock::now();
+    core.run();
+    auto elapsed = chrono::steady_clock::now() - start;
+
+    unsigned long interrupts = 0;
+    for (unsigned long count : core.metrics.interrupts) {
+        interrupts += count;
+    }
+
+    stringstream response;
+    response << "ok\n";
+    response << "hash " << hex << setw(16) << setfill('0') << hash << "\n";
+    response << "cache " << (cached ? "hit" : "miss") << "\n";
+    response << "halted " << (core.is_running() ? "no" : "yes") << "\n";
+    response << "instructions " << dec << core.metrics.instructions << "\n";
+    response << "interrupts " << interrupts << "\n";
+    response << "time_us "
+             << chrono::duration_cast<chrono::microseconds>(elapsed).count()
+             << "\n";
+    core.print_state(response);
+    return response.str();
+}
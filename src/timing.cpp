@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "emulator.hpp"
+
+using namespace std;
+
+Cache::Cache(string name, unsigned int size, unsigned int line_size,
+             unsigned int ways)
+    : name(name), line_size(line_size), ways(ways) {
+    if (line_size == 0 || ways == 0 || size < line_size * ways ||
+        size % (line_size * ways) != 0) {
+        cout << "Invalid " << name << " geometry!" << endl;
+        exit(-1);
+    }
+    sets = size / (line_size * ways);
+    lines.resize(sets * ways);
+}
+
+bool Cache::access(unsigned int address) {
+    unsigned int line_address = address / line_size;
+    unsigned int set = line_address % sets;
+    unsigned int tag = line_address / sets;
+    CacheLine *set_lines = &lines[set * ways];
+    CacheLine *victim = set_lines;
+    clock++;
+
+    for (unsigned int i = 0; i < ways; i++) {
+        if (set_lines[i].valid && set_lines[i].tag == tag) {
+            set_lines[i].last_used = clock;
+            hits++;
+            return true;
+        }
+        if (!set_lines[i].valid ||
+            (victim->valid && set_lines[i].last_used < victim->last_used)) {
+            victim = &set_lines[i];
+        }
+    }
+
+    victim->valid = true;
+    victim->tag = tag;
+    victim->last_used = clock;
+    misses++;
+    miss_addresses[line_address * line_size]++;
+    return false;
+}
+
+void Cache::report(int top_misses) {
+    unsigned long accesses = hits + misses;
+    double hit_rate = accesses ? 100.0 * hits / accesses : 0;
+    cout << name << ": " << dec << accesses << " accesses, " << hits
+         << " hits, " << misses << " misses, hit rate " << fixed
+         << setprecision(2) << hit_rate << "%\n";
+
+    vector<pair<unsigned int, unsigned long>> sorted(miss_addresses.begin(),
+                                                     miss_addresses.end());
+    sort(sorted.begin(), sorted.end(), [](auto &a, auto &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    if (sorted.size() > (size_t)top_misses) {
+        sorted.resize(top_misses);
+    }
+    for (auto &entry : sorted) {
+        cout << "  0x" << hex << setw(8) << setfill('0') << entry.first << ": "
+             << dec << entry.second << " misses\n";
+    }
+}
+
+TimingModel::TimingModel() {
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            latency[i][j] = 1;
+        }
+    }
+}
+
+void TimingModel::load_config(string config_file_name) {
+    // -1 stands for every mode of the instruction
+    unordered_map<string, pair<int, int>> opcodes = {
+        {"halt", {HALT, -1}}, {"int", {INT, -1}},   {"call", {CALL, -1}},
+        {"jmp", {JUMP, -1}},  {"xchg", {XCHG, -1}}, {"add", {ARIT, ADD}},
+        {"sub", {ARIT, SUB}}, {"mul", {ARIT, MUL}}, {"div", {ARIT, DIV}},
+        {"not", {LOG, NOT}},  {"and", {LOG, AND}},  {"or", {LOG, OR}},
+        {"xor", {LOG, XOR}},  {"shl", {SH, SHL}},   {"shr", {SH, SHR}},
+        {"st", {ST, -1}},     {"ld", {LD, -1}}};
+
+    ifstream file(config_file_name);
+    if (!file) {
+        cout << "Failed to open file " << config_file_name << endl;
+        exit(-1);
+    }
+
+    // explicit latencies override the default wherever it appears
+    int default_latency = -1;
+    vector<pair<pair<int, int>, unsigned int>> latencies;
+    string line;
+    int line_num = 0;
+    while (getline(file, line)) {
+        line_num++;
+        line = line.substr(0, line.find('#'));
+        stringstream line_stream(line);
+        string key;
+        if (!(line_stream >> key)) {
+            continue;
+        }
+
+        if (key == "icache" || key == "dcache") {
+            unsigned int size, line_size, ways;
+            if (!(line_stream >> size >> line_size >> ways)) {
+                cout << "Expected <size> <line_size> <ways> at line "
+                     << line_num << " of " << config_file_name << endl;
+                exit(-1);
+            }
+            Cache *cache = new Cache(key, size, line_size, ways);
+            (key == "icache" ? icache : dcache) = cache;
+            continue;
+        }
+
+        unsigned int value;
+        if (!(line_stream >> value)) {
+            cout << "Expected a number at line " << line_num << " of "
+                 << config_file_name << endl;
+            exit(-1);
+        }
+
+        if (key == "miss_penalty") {
+            miss_penalty = value;
+        } else if (key == "top_misses") {
+            top_misses = value;
+        } else if (key == "default") {
+            default_latency = value;
+        } else if (opcodes.find(key) != opcodes.end()) {
+            latencies.push_back({opcodes[key], value});
+        } else {
+            cout << "Unknown key " << key << " at line " << line_num << " of "
+                 << config_file_name << endl;
+            exit(-1);
+        }
+    }
+    file.close();
+
+    if (default_latency != -1) {
+        for (int i = 0; i < 16; i++) {
+            for (int j = 0; j < 16; j++) {
+                latency[i][j] = default_latency;
+            }
+        }
+    }
+    for (auto &entry : latencies) {
+        pair<int, int> opcode = entry.first;
+        for (int j = 0; j < 16; j++) {
+            if (opcode.second == -1 || opcode.second == j) {
+                latency[opcode.first][j] = entry.second;
+            }
+        }
+    }
+}
+
+void TimingModel::report() {
+    cout << "-----------------------------------------------------------------"
+         << "\n";
+    cout << "Timing model:\n";
+    cout << "Instructions: " << dec << instructions << "\n";
+    cout << "Estimated cycles: " << cycles << "\n";
+    if (instructions) {
+        cout << "CPI: " << fixed << setprecision(2)
+             << (double)cycles / instructions << "\n";
+    }
+    if (icache) {
+        icache->report(top_misses);
+    }
+    if (dcache) {
+        dcache->report(top_misses);
+    }
+}
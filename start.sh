@@ -2,12 +2,10 @@ ASSEMBLER=./assembler
 LINKER=./linker
 EMULATOR=./emulator
 
-${ASSEMBLER} -o main.o test/main.s
-${ASSEMBLER} -o math.o test/math.s
-${ASSEMBLER} -o handler.o test/handler.s
-${ASSEMBLER} -o isr_timer.o test/isr_timer.s
-${ASSEMBLER} -o isr_terminal.o test/isr_terminal.s
-${ASSEMBLER} -o isr_software.o test/isr_software.s
+${ASSEMBLER} -j 6 \
+  -o main.o test/main.s -o math.o test/math.s -o handler.o test/handler.s \
+  -o isr_timer.o test/isr_timer.s -o isr_terminal.o test/isr_terminal.s \
+  -o isr_software.o test/isr_software.s
 ${LINKER} -hex \
   -place=my_code@0x40000000 -place=math@0xF0000000 \
   -o program.hex \
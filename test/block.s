@@ -0,0 +1,50 @@
+# Writes a sector of a two sector disk, reads it back into another buffer
+# and then asks for a sector past the end. Interrupts stay masked, the
+# status is polled.
+.section my_code
+    ld $0xFFFFFEFE, %sp
+    ld $4, %r1
+    csrwr %r1, %status
+    ld $0xFFFFFF20, %r12
+    ld [%r12 + 16], %r5
+
+    ld $1, %r1
+    st %r1, [%r12]
+    st %r1, [%r12 + 4]
+    ld $out, %r1
+    st %r1, [%r12 + 8]
+    ld $2, %r1
+    call command
+    ld %r13, %r6
+
+    ld $in, %r1
+    st %r1, [%r12 + 8]
+    ld $1, %r1
+    call command
+    ld %r13, %r7
+    ld $in, %r1
+    ld [%r1], %r8
+    ld [%r1 + 4], %r9
+
+    ld $2, %r1
+    st %r1, [%r12]
+    ld $1, %r1
+    call command
+    ld %r13, %r10
+    halt
+
+# issues the command in %r1, %r13 is the final status
+command:
+    st %r1, [%r12 + 12]
+    ld $1, %r1
+wait:
+    ld [%r12 + 12], %r13
+    beq %r13, %r1, wait
+    ret
+
+out:
+    .word 0x11223344, 0x55667788
+    .skip 504
+in:
+    .skip 512
+.end
@@ -0,0 +1,113 @@
+#!/bin/sh
+# Assembles the test programs and compares the results with the expected
+# output next to them. Run from the repository root after make all.
+
+ROOT=$(pwd)
+ASSEMBLER=${ROOT}/assembler
+LINKER=${ROOT}/linker
+EMULATOR=${ROOT}/emulator
+OUT=$(mktemp -d)
+failed=0
+
+# name expected [flags]: flags only label the result
+compare() {
+    if diff -u test/$2.expected $OUT/$1.out > $OUT/$1.diff; then
+        echo "ok   $(echo $2 $3)"
+    else
+        echo "FAIL $(echo $2 $3)"
+        cat $OUT/$1.diff
+        failed=1
+    fi
+}
+
+# name [expected] [assembler flags]: the text object of test/name.s
+object() {
+    ${ASSEMBLER} -text $3 -o $OUT/$1.o test/$1.s > $OUT/$1.out 2>&1 &&
+        cat $OUT/$1.o >> $OUT/$1.out
+    compare $1 ${2:-$1} "$3"
+}
+
+# name [expected] [assembler flags] [emulator flags] [objects]: what
+# test/name.s prints when run from my_code, linked with the objects and
+# math.o placed at 0xF0000000, in a directory of its own, for at most ten
+# seconds. The symbol map is written to name.map.
+run() {
+    ${ASSEMBLER} $3 -o $OUT/$1.o test/$1.s > $OUT/$1.out 2>&1 &&
+        (cd $OUT && ${LINKER} -hex -place=my_code@0x40000000 \
+            -place=math@0xF0000000 -map=$1.map -o $1.hex $1.o $5 \
+            > /dev/null &&
+            timeout 10 ${EMULATOR} $1.hex $4 >> $1.out 2>&1)
+    compare $1 ${2:-$1} "$3 $4"
+}
+
+${ASSEMBLER} -o $OUT/math.o test/math.s
+
+object pool_label
+object pool_order
+object reach
+run relax
+run peephole
+run peephole peephole_O -O
+object peephole peephole_object -O
+run semihosting semihosting "" -semihosting
+# a zeroed disk of two sectors
+head -c 1024 /dev/zero > $OUT/disk.img
+run block block "" -block=disk.img
+run dma dma "" -dma
+run dma dma "" -dma-rate=3
+run vectors vectors "" "-guard=0x50000000:0x1000 -guard-trap"
+run vectors vectors "" "-guard=0x50000000:0x1000 -guard-trap -fast"
+HOOKS="-hook=mathAdd -hook=mathSub -hook=mathMul -hook=mathDiv"
+run hooks hooks "" "" math.o
+run hooks hooks_native "" "$HOOKS -symbols=hooks.map" math.o
+run hooks hooks_verify "" "$HOOKS -symbols=hooks.map -hook-verify" math.o
+run self_modifying
+run self_modifying self_modifying "" -fast
+run self_modifying self_modifying_cosim "" -cosim
+cp test/timing.cfg $OUT
+run timing timing "" -timing=timing.cfg
+run counters
+run counters counters "" -fast
+run cores cores "" -cores=2
+run cores cores "" "-cores=2 -fast"
+# the counters written when the run ends, without the rate, which varies
+run vectors vectors "" \
+    "-guard=0x50000000:0x1000 -guard-trap -fast -metrics=vectors.prom"
+grep -v emulator_mips $OUT/vectors.prom > $OUT/metrics.out
+compare metrics metrics
+# the lcov report of a run with line info and the symbol map
+${ASSEMBLER} -g -o $OUT/coverage.o test/coverage.s > $OUT/coverage.out 2>&1 &&
+    (cd $OUT && ${LINKER} -hex -place=my_code@0x40000000 -map=coverage.map \
+        -lines=coverage.lines -o coverage.hex coverage.o > /dev/null &&
+        ${EMULATOR} coverage.hex -coverage=coverage.info \
+            -lines=coverage.lines -symbols=coverage.map > /dev/null &&
+        cat coverage.info >> coverage.out)
+compare coverage coverage
+# Three persistent cases of one input through AFL's fork server pipes. The
+# child stops between cases (status 0x137f) and exits with 0 after the
+# last. A case that saw memory from the one before would crash instead.
+fuzz_word() {
+    dd bs=4 count=1 <&4 2> /dev/null | od -An -tx4 | tr -d ' '
+}
+${ASSEMBLER} -o $OUT/fuzz.o test/fuzz.s > $OUT/fuzz.out 2>&1 &&
+    (cd $OUT && ${LINKER} -hex -place=my_code@0x40000000 -o fuzz.hex \
+        fuzz.o > /dev/null && printf abcd > fuzz.in &&
+        mkfifo control status &&
+        # dash can't redirect the descriptors above 9 the pipes live on
+        (bash -c 'exec "$@" 198< control 199> status' fuzz timeout 10 \
+            ${EMULATOR} fuzz.hex -fuzz-entry=0x40000004 \
+            -fuzz-buffer=0x50001000:0x100 -guard=0x50000000:0x1000 \
+            -fuzz-file=fuzz.in -fuzz-iterations=3 &
+            exec 3> control 4< status
+            echo "hello $(fuzz_word)"
+            for case in 1 2 3; do
+                printf '\0\0\0\0' >&3
+                fuzz_word > /dev/null
+                echo "case $case status $(fuzz_word)"
+            done
+            exec 3>&- 4<&-
+            wait) >> fuzz.out 2>&1)
+compare fuzz fuzz
+
+rm -rf $OUT
+exit $failed
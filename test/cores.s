@@ -0,0 +1,37 @@
+# Two cores run the same image. Core 0 sets up its handler and marks
+# itself ready, core 1 waits for that, stores to done and interrupts core
+# 0, whose handler lets it go on to read done.
+.section my_code
+    ld $0x60000000, %sp
+    ld $handler, %r2
+    csrwr %r2, %handler
+    csrrd %coreid, %r1
+    beq %r1, %r0, first
+
+    ld $ready, %r2
+wait_ready:
+    ld [%r2], %r4
+    beq %r4, %r0, wait_ready
+    ld $42, %r3
+    st %r3, done
+    csrwr %r0, %ipi
+    halt
+
+first:
+    ld $1, %r4
+    st %r4, ready
+wait_interrupt:
+    beq %r6, %r0, wait_interrupt
+    ld done, %r3
+    halt
+
+handler:
+    csrrd %cause, %r5
+    ld $1, %r6
+    iret
+
+ready:
+    .word 0
+done:
+    .word 0
+.end
@@ -0,0 +1,17 @@
+# The counter CSRs after a software interrupt: six instructions retired
+# before the first read, iret being two, a cycle estimate that follows the
+# instructions without -timing, one interrupt taken and core 0.
+.section my_code
+    ld $0x60000000, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    int
+    csrrd %instret, %r2
+    csrrd %cycle, %r3
+    csrrd %intcount, %r4
+    csrrd %coreid, %r5
+    halt
+
+handler:
+    iret
+.end
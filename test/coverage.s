@@ -0,0 +1,17 @@
+# Coverage with line info: the loop branch is taken once and falls
+# through once, and the function unused is never reached.
+.global start, unused
+.section my_code
+start:
+    ld $0, %r1
+    ld $2, %r2
+    ld $1, %r3
+loop:
+    add %r3, %r1
+    bne %r1, %r2, loop
+    halt
+
+unused:
+    ld $7, %r5
+    ret
+.end
@@ -0,0 +1,57 @@
+# Overlapping copies in both directions, polled until done with interrupts
+# masked. Run at once and a few bytes per instruction, the results must
+# match a single memmove.
+.section my_code
+    ld $0xFFFFFEFE, %sp
+    ld $4, %r1
+    csrwr %r1, %status
+    ld $0xFFFFFF40, %r12
+
+    # up by one word: 1 2 3 4 5 becomes 1 1 2 3 4
+    ld $up, %r1
+    st %r1, [%r12]
+    ld $up_next, %r1
+    st %r1, [%r12 + 4]
+    call copy
+
+    # down by one word: 6 7 8 9 10 becomes 7 8 9 10 10
+    ld $down_next, %r1
+    st %r1, [%r12]
+    ld $down, %r1
+    st %r1, [%r12 + 4]
+    call copy
+
+    ld $up, %r1
+    ld [%r1 + 4], %r2
+    ld [%r1 + 8], %r3
+    ld [%r1 + 12], %r4
+    ld [%r1 + 16], %r5
+    ld $down, %r1
+    ld [%r1], %r6
+    ld [%r1 + 4], %r7
+    ld [%r1 + 8], %r8
+    ld [%r1 + 12], %r9
+    ld [%r1 + 16], %r10
+    halt
+
+# sixteen bytes from DMA_SOURCE to DMA_DESTINATION, r13 is the final status
+copy:
+    ld $16, %r1
+    st %r1, [%r12 + 8]
+    ld $1, %r1
+    st %r1, [%r12 + 12]
+    ld $1, %r1
+wait:
+    ld [%r12 + 12], %r13
+    beq %r13, %r1, wait
+    ret
+
+up:
+    .word 1
+up_next:
+    .word 2, 3, 4, 5
+down:
+    .word 6
+down_next:
+    .word 7, 8, 9, 10
+.end
@@ -0,0 +1,15 @@
+# Counts its fuzz cases at 0x50002000 and reads the guard page at
+# 0x50000000 unless the count is 1, so every case has to start from the
+# snapshot taken at entry.
+.section my_code
+    ld $0x60000000, %sp
+entry:
+    ld 0x50002000, %r1
+    ld $1, %r2
+    add %r2, %r1
+    st %r1, 0x50002000
+    beq %r1, %r2, first
+    ld 0x50000000, %r3
+first:
+    halt
+.end
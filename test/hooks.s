@@ -0,0 +1,39 @@
+# Calls into math.s, the last one divides by zero. Run with and without
+# native hooks, the registers left behind are the same: the native division
+# leaves a zero divisor to the guest code, whose div traps.
+.extern mathAdd, mathSub, mathMul, mathDiv
+.section my_code
+    ld $0xFFFFFEFE, %sp
+    ld $trap, %r1
+    csrwr %r1, %handler
+    ld $8, %r10
+
+    ld $3, %r1
+    push %r1
+    ld $20, %r1
+    push %r1
+    call mathAdd
+    ld %r1, %r4
+    call mathSub
+    ld %r1, %r5
+    call mathMul
+    ld %r1, %r6
+    call mathDiv
+    ld %r1, %r7
+    add %r10, %sp
+
+    ld $0, %r1
+    push %r1
+    ld $7, %r1
+    push %r1
+    call mathDiv
+    ld %r1, %r8
+    add %r10, %sp
+    halt
+
+# counts the traps, the division then returns its dividend
+trap:
+    ld $1, %r11
+    add %r11, %r9
+    iret
+.end
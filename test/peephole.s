@@ -0,0 +1,61 @@
+# Assembled with and without -O, the program leaves the same registers
+# behind. Each rewrite of the peephole pass appears in the loop, followed
+# by the cases that must be left alone.
+.section my_code
+    ld $0xFFFFFEFE, %sp
+    ld $3, %r3
+    ld $1, %r4
+loop:
+    # removed
+    push %r5
+    pop %r5
+    # the inner pair becomes ld %r6, %r7
+    push %r4
+    push %r6
+    pop %r7
+    pop %r9
+    # the second load of each value is removed
+    ld $0x12345, %r2
+    add %r2, %r5
+    ld $0x12345, %r2
+    add %r2, %r6
+    ld $counter, %r10
+    ld $counter, %r10
+    ld [%r10], %r11
+    add %r4, %r11
+    st %r11, [%r10]
+    # removed
+    ld %r5, %r5
+    # both removed
+    beq %r0, %r0, next
+next:
+    sub %r4, %r3
+    jmp tail
+tail:
+    bne %r3, %r0, loop
+
+    # the label makes the pop a place of its own, the second way in pops
+    # what was pushed before the jump
+    ld $0x22, %r2
+    push %r2
+pop_here:
+    pop %r12
+    bne %r12, %r2, done
+    ld $0x44, %r2
+    push %r2
+    ld $0x33, %r2
+    jmp pop_here
+done:
+    # the register changed in between, both loads stay
+    ld $7, %r6
+    add %r4, %r6
+    ld $7, %r6
+    add %r6, %r13
+    ld $5, %r1
+    pop %r1
+    ld $5, %r1
+    add %r1, %r13
+    halt
+counter:
+    .word 0
+.end
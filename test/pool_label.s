@@ -0,0 +1,17 @@
+# Labels in front of data that the open pool does not fit before. The pool
+# has to go down ahead of the label, so that the label names the data.
+.global word_label, skip_label
+
+.section skip_case
+    ld $0x12345678, %r1
+.global skip_label
+skip_label:
+    .skip 3000
+
+.section word_case
+    ld $0x0BADCAFE, %r2
+.global word_label
+    .skip 2036
+word_label:
+    .word 0x11111111
+.end
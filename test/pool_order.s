@@ -0,0 +1,19 @@
+# Pool slots follow the order of first use, literals before symbols.
+.extern zeta, alpha, mid
+
+.section my_code
+    ld $0x70000000, %r1
+    ld $zeta, %r2
+    ld $0x10000000, %r3
+    ld $alpha, %r4
+    ld $0x70000000, %r5
+    ld $0x40000000, %r6
+    ld $mid, %r7
+    ld $zeta, %r8
+    halt
+.ltorg
+    ld $alpha, %r9
+    ld $0x50000000, %r10
+    ld $0x10000000, %r11
+    halt
+.end
@@ -0,0 +1,48 @@
+# Short forms at the edges of the 12 bit displacement. Each case has a
+# section of its own, so that its displacement is exact.
+
+# literals from -2048 to 2047 are encoded in the instruction
+.section literals
+    ld $0xFFFFF800, %r1
+    ld $0xFFFFF7FF, %r2
+    ld $0x7FF, %r3
+    ld $0x800, %r4
+    ld 0x7FF, %r5
+    ld 0x800, %r6
+    jmp 0x7FF
+    jmp 0x800
+    call 0xFFFFF800
+    beq %r1, %r2, 0xFFFFF7FF
+    halt
+
+# from the next instruction back to the symbol, -0x800 fits
+.section back_in
+back_in:
+    .skip 2044
+    ld $back_in, %r1
+    jmp back_in
+    halt
+
+# -0x801 does not
+.section back_out
+back_out:
+    .skip 2045
+    ld $back_out, %r1
+    halt
+
+# Forward symbols are first loaded from the pool, which goes down with a
+# jump around it before the data. 0x7FF away as of that layout, the next
+# pass makes the load relative to pc and drops the pool again.
+.section forward_in
+    ld $forward_in, %r1
+    .skip 2039
+forward_in:
+    .word 0
+
+# one byte farther it stays in the pool
+.section forward_out
+    ld $forward_out, %r1
+    .skip 2040
+forward_out:
+    .word 0
+.end
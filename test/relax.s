@@ -0,0 +1,18 @@
+# Loads that settle over several passes, and literals at the edges of the
+# 12 bit range. The first pass loads both words from the pool. The next
+# one reaches first relative to pc, which shortens the code and brings
+# second within 0x7FF, so that a third pass relaxes it too.
+.section my_code
+    ld first, %r1
+    ld second, %r2
+    ld $0xFFFFF800, %r3
+    ld $0xFFFFF7FF, %r4
+    ld $0x7FF, %r5
+    ld $0x800, %r6
+    halt
+first:
+    .word 0x11111111
+    .skip 2007
+second:
+    .word 0x22222222
+.end
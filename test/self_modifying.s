@@ -0,0 +1,28 @@
+# A software interrupt pushes the status word over code that has already
+# run, so a fast engine has it decoded. The status is 0, the encoding of
+# halt, so the second call stops in victim instead of adding again.
+.section my_code
+    ld $0x60000000, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    ld $0, %r1
+    csrwr %r1, %status
+    ld $0, %r2
+    ld $1, %r3
+    call victim
+
+    # the interrupt pushes pc over the ret and the status over the add
+    ld $victim_end, %sp
+    int
+    halt
+
+handler:
+    ld $0x60000000, %sp
+    call victim
+    halt
+
+victim:
+    add %r3, %r2
+    ret
+victim_end:
+.end
@@ -0,0 +1,82 @@
+# Writes a line to stdout, then writes it to a host file, reads it back and
+# checks it, all through semihosting. Each result is kept in a register.
+.section my_code
+    ld $0xFFFFFEFE, %sp
+    ld $arguments, %r2
+
+    # the line goes to stdout
+    ld $0x5E4D0007, %r1
+    ld $1, %r3
+    ld $line, %r4
+    ld $3, %r12
+    call host
+    ld %r1, %r5
+    # its length
+    ld $0x5E4D0004, %r1
+    ld $line, %r3
+    call host
+    ld %r1, %r6
+
+    # written to a new file
+    ld $0x5E4D0005, %r1
+    ld $path, %r3
+    ld $1, %r4
+    call host
+    ld %r1, %r7
+    ld $0x5E4D0007, %r1
+    ld %r7, %r3
+    ld $line, %r4
+    ld $3, %r12
+    call host
+    ld $0x5E4D0008, %r1
+    ld %r7, %r3
+    call host
+
+    # and read back, at most 16 bytes
+    ld $0x5E4D0005, %r1
+    ld $path, %r3
+    ld $0, %r4
+    call host
+    ld %r1, %r8
+    ld $0x5E4D0006, %r1
+    ld %r8, %r3
+    ld $buffer, %r4
+    ld $16, %r12
+    call host
+    ld %r1, %r9
+    ld $0x5E4D0003, %r1
+    ld $buffer, %r3
+    ld $line, %r4
+    ld $3, %r12
+    call host
+    ld %r1, %r10
+
+    # the first two bytes overwritten with 'A'
+    ld $0x5E4D0002, %r1
+    ld $buffer, %r3
+    ld $0x41, %r4
+    ld $2, %r12
+    call host
+    ld $buffer, %r1
+    ld [%r1], %r11
+    halt
+
+# service in %r1, its arguments in %r3, %r4 and %r12
+host:
+    st %r3, [%r2]
+    st %r4, [%r2 + 4]
+    st %r12, [%r2 + 8]
+    int
+    ret
+
+arguments:
+    .word 0, 0, 0
+# "hi\n"
+line:
+    .word 0x000A6968
+# "o.txt"
+path:
+    .word 0x78742E6F, 0x00000074
+buffer:
+    .skip 16
+.end
@@ -0,0 +1,10 @@
+# Four adds at 5 cycles each, the rest at the default of 2 although it
+# comes after add in timing.cfg: 24 cycles for 6 instructions.
+.section my_code
+    ld $1, %r1
+    add %r1, %r2
+    add %r1, %r2
+    add %r1, %r2
+    add %r1, %r2
+    halt
+.end
@@ -0,0 +1,33 @@
+# Vectored interrupts through a .vectors table: a software interrupt and a
+# division by zero each reach their own handler, then a guard page fault,
+# whose cause is left out of the list, goes to the first one. Run with a
+# trapping guard at 0x50000000.
+.section my_code
+    ld $0xFFFFFEFE, %sp
+    ld $table, %r1
+    csrwr %r1, %handler
+    csrrd %status, %r1
+    ld $8, %r2
+    or %r2, %r1
+    csrwr %r1, %status
+
+    int
+    ld $0, %r3
+    div %r3, %r2
+    ld $0x50000000, %r1
+    ld [%r1], %r4
+    halt
+
+fallback:
+    csrrd %cause, %r5
+    halt
+invalid:
+    csrrd %cause, %r6
+    iret
+software:
+    csrrd %cause, %r7
+    iret
+
+table:
+    .vectors fallback, invalid, fallback, fallback, software
+.end